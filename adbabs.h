@@ -0,0 +1,16 @@
+#ifndef ADBABS_H
+#define ADBABS_H
+
+// a TM1001A report in absolute mode, decoded by adbGetAbsModeData() in tm1001a.h
+
+#include <stdint.h>
+
+struct adbAbsMode
+{
+    int xpos, ypos, pressure;
+    unsigned int button: 1, gesture: 1;
+};
+
+void adbGetAbsModeData(struct adbAbsMode *ret, const uint8_t *adbData);
+
+#endif //ADBABS_H
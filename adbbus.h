@@ -0,0 +1,166 @@
+#ifndef ADBBUS_H
+#define ADBBUS_H
+
+// ADB bus on top of the transceiver in tm1001a.h. adbBusEnumerate() moves every
+// device off its power-on address at setup, so several of the same kind can share
+// the line. polling then talks to one device only, the one that reported last;
+// another one with a report holds the stop bit low (service request) and gets the
+// next turn. one transaction per poll covers the whole bus however many devices
+// are on it, and an empty answer without a service request means nobody has news.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <avr/pgmspace.h>
+
+#ifndef ADB_MAX_DEVICES
+#define ADB_MAX_DEVICES     4
+#endif
+#define ADB_FIRST_FREE      8       // addresses 8-15 are handed out
+
+enum adbKind
+{
+    ADB_KIND_OTHER,
+    ADB_KIND_PAD,                   // set up by the application, e.g. TM1001A in absolute mode
+};
+
+struct adbBusDevice
+{
+    uint8_t address;
+    uint8_t defaultAddress;         // power-on address, tells the device class
+    uint8_t handler;
+    uint8_t kind;
+    uint32_t reports;
+};
+
+struct
+{
+    struct adbBusDevice devices[ADB_MAX_DEVICES];
+    uint8_t count;
+    uint8_t current;                // polled until another one asks for service
+    uint8_t srq;                    // the last poll saw a service request
+    uint32_t polls, empty, srqs;
+} adbBus;
+
+// hold the line low for 4 ms (a reset is 3 ms or more): all devices go back to their power-on address and handler
+void adbBusReset(void)
+{
+    uint8_t t;
+    adbPinLo();
+    for(uint8_t i= 0; i<4; ++i)
+    {
+        t= ADB_TCNT + microsToTicks(1000);
+        while(ADB_TCNT>t) ;
+        while(ADB_TCNT<t) ;
+    }
+    adbPinHi();
+    t= ADB_TCNT + microsToTicks(1000);
+    while(ADB_TCNT>t) ;
+    while(ADB_TCNT<t) ;
+}
+
+// returns true if a device answered, with its handler id
+bool adbTalkRegister3(uint8_t address, uint8_t *handler)
+{
+    uint8_t data[8];
+    if(adbExecuteCommand(ADB_cmdByte(ADBCMD_TALK, address, 3), data, 0)<2)
+        return false;
+    *handler= data[1];
+    return true;
+}
+
+// new address and handler, exceptional events and service requests enabled.
+// handler 0xFE only moves the device, and only if it didn't collide in the last talk
+void adbListenRegister3(uint8_t address, uint8_t newAddress, uint8_t handler)
+{
+    uint8_t data[2]= { 0x60 | newAddress, handler };
+    adbExecuteCommand(ADB_cmdByte(ADBCMD_LISTEN, address, 3), data, 2);
+}
+
+// blocking, at setup. identical devices answer a talk together with random
+// addresses in register 3; the one that loses the line stays behind when the
+// winner moves and answers in the next round. returns the number of devices.
+// with none found it keeps one entry at address 3 so polling works as before.
+uint8_t adbBusEnumerate(void)
+{
+    uint8_t next= ADB_FIRST_FREE;
+    adbBus.count= adbBus.current= 0;
+    adbBusReset();
+    for(uint8_t a= 1; a<ADB_FIRST_FREE; ++a)
+    {
+        uint8_t handler;
+        while(adbBus.count<ADB_MAX_DEVICES && adbTalkRegister3(a, &handler))
+        {
+            struct adbBusDevice *d= &adbBus.devices[adbBus.count++];
+            bool moved= false;
+            if(next<16)
+            {
+                adbListenRegister3(a, next, 0xFE);
+                moved= adbTalkRegister3(next, &handler);
+            }
+            d->address= moved? next++: a;
+            d->defaultAddress= a;
+            d->handler= handler;
+            d->kind= ADB_KIND_OTHER;
+            d->reports= 0;
+            if(!moved)
+                break;
+        }
+    }
+    if(!adbBus.count)
+    {
+        struct adbBusDevice *d= &adbBus.devices[adbBus.count++];
+        d->address= d->defaultAddress= 3;
+        d->handler= 1;
+        d->kind= ADB_KIND_OTHER;
+    }
+    return adbBus.count;
+}
+
+// TALK register 0 to the current device
+void adbBusPollStart(void)
+{
+    adbBus.polls++;
+    adbTalkStart(adbBus.devices[adbBus.current].address, 0);
+}
+
+// like adbPollResult(), 'device' is the index of the device that answered.
+// on a service request the next device is up and adbBus.srq is set, poll again soon
+int8_t adbBusPollResult(uint8_t *data, uint8_t *device)
+{
+    int8_t n= adbPollResult(data);
+    if(n==ADB_BUSY)
+        return n;
+    *device= adbBus.current;
+    if(n>0)
+        adbBus.devices[adbBus.current].reports++;
+    else if(!n)
+        adbBus.empty++;
+    adbBus.srq= adbAsync.srq;
+    if(adbBus.srq)
+    {
+        adbBus.srqs++;
+        if(++adbBus.current>=adbBus.count)
+            adbBus.current= 0;
+    }
+    return n;
+}
+
+// one line per device: address, power-on address, handler, kind, reports; then the poll counts.
+// a listing row, false past the last
+bool adbBusPrint(uint8_t row)
+{
+    if(row<adbBus.count)
+    {
+        const struct adbBusDevice *d= &adbBus.devices[row];
+        printf_P(d->kind==ADB_KIND_PAD? PSTR("%2u %2u %3u pad   %lu\n"): PSTR("%2u %2u %3u other %lu\n"),
+                 d->address, d->defaultAddress, d->handler, (unsigned long)d->reports);
+        return true;
+    }
+    if(row>adbBus.count)
+        return false;
+    printf_P(PSTR("polls %lu, empty %lu, service requests %lu\n"), (unsigned long)adbBus.polls,
+             (unsigned long)adbBus.empty, (unsigned long)adbBus.srqs);
+    return true;
+}
+
+#endif //ADBBUS_H
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <string.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include "calibration.h"
+
+#define CLAMP(V, min, max) do { if(V<min) V= min; if(V>max) V= max; } while(0)
+
+struct calibration calibration=
+{
+    { { CAL_ONE, 0, 0 }, { 0, CAL_ONE, 0 }, { 0, 0, CAL_ONE } },
+    { 0, 0, 0 },
+    0
+};
+
+// what calibrate() applies, only written with interrupts disabled
+static struct
+{
+    int16_t matrix[3][3];
+    int16_t offset[3];
+    bool identity;
+} active= { .identity= true };
+
+// black body white points, every KELVIN_STEP from CAL_KELVIN_MIN. Tanner
+// Helland's fit of the sRGB values, linearized with gamma 2.2 and encoded with
+// CIE L* like the values calibrate() gets, which the default curve linearizes
+// afterwards; computed by the compiler like the brightness curves
+#define KELVIN_STEP         500
+#define KELVIN_POINTS       ((CAL_KELVIN_MAX-CAL_KELVIN_MIN)/KELVIN_STEP+1)
+#define KELVIN_T(i)         ((CAL_KELVIN_MIN+(i)*KELVIN_STEP)/100.0)
+#define KELVIN_R(t)         ((t)<=66? 255: 329.698727446*__builtin_pow((t)>60? (t)-60: 1, -0.1332047592))
+#define KELVIN_G(t)         ((t)<=66? 99.4708025861*__builtin_log(t)-161.1195681661: \
+                                      288.1221695283*__builtin_pow((t)>60? (t)-60: 1, -0.0755148492))
+#define KELVIN_B(t)         ((t)>=66? 255: (t)<=19? 0: 138.5177312231*__builtin_log((t)>10? (t)-10: 1)-305.0447927307)
+#define KELVIN_LSTAR(y)     ((y)<=0.008856? (y)*9.033: 1.16*__builtin_cbrt(y)-0.16)
+#define KELVIN_ENC(x)       ((x)<=0? 0: (x)>=255? CAL_ONE: \
+                             (uint16_t)(KELVIN_LSTAR(__builtin_pow((x)/255.0, 2.2))*CAL_ONE+0.5))
+#define KELVIN_AT(i)        { KELVIN_ENC(KELVIN_R(KELVIN_T(i))), KELVIN_ENC(KELVIN_G(KELVIN_T(i))), \
+                              KELVIN_ENC(KELVIN_B(KELVIN_T(i))) }
+
+static const uint16_t kelvinGains[KELVIN_POINTS][3] PROGMEM=
+{
+    KELVIN_AT(0), KELVIN_AT(1), KELVIN_AT(2), KELVIN_AT(3), KELVIN_AT(4), KELVIN_AT(5),
+    KELVIN_AT(6), KELVIN_AT(7), KELVIN_AT(8), KELVIN_AT(9), KELVIN_AT(10), KELVIN_AT(11),
+    KELVIN_AT(12), KELVIN_AT(13), KELVIN_AT(14), KELVIN_AT(15), KELVIN_AT(16), KELVIN_AT(17),
+    KELVIN_AT(18), KELVIN_AT(19), KELVIN_AT(20), KELVIN_AT(21), KELVIN_AT(22),
+};
+
+void calibrationReset(struct calibration *c)
+{
+    memset(c, 0, sizeof(*c));
+    for(uint8_t i= 0; i<3; ++i)
+        c->matrix[i][i]= CAL_ONE;
+}
+
+void calibrationLimit(struct calibration *c)
+{
+    for(uint8_t i= 0; i<3; ++i)
+    {
+        for(uint8_t k= 0; k<3; ++k)
+            CLAMP(c->matrix[i][k], -CAL_LIMIT, CAL_LIMIT);
+        CLAMP(c->offset[i], -CAL_RGB_MAX, CAL_RGB_MAX);
+    }
+    if(c->kelvin)
+        CLAMP(c->kelvin, CAL_KELVIN_MIN, CAL_KELVIN_MAX);
+}
+
+uint16_t calibrationKelvinGain(uint16_t kelvin, uint8_t channel)
+{
+    if(!kelvin)
+        return CAL_ONE;
+    CLAMP(kelvin, CAL_KELVIN_MIN, CAL_KELVIN_MAX);
+    uint8_t i= (kelvin-CAL_KELVIN_MIN)/KELVIN_STEP;
+    uint16_t frac= (kelvin-CAL_KELVIN_MIN)%KELVIN_STEP;
+    int16_t g0= pgm_read_word(&kelvinGains[i][channel]);
+    if(i==KELVIN_POINTS-1)
+        return g0;
+    int16_t g1= pgm_read_word(&kelvinGains[i+1][channel]);
+    return g0 + (int32_t)(g1-g0)*frac/KELVIN_STEP;
+}
+
+void calibrationApply(void)
+{
+    int16_t matrix[3][3];
+    bool identity= true;
+    for(uint8_t i= 0; i<3; ++i)
+    {
+        uint16_t gain= calibrationKelvinGain(calibration.kelvin, i);
+        for(uint8_t k= 0; k<3; ++k)
+        {
+            matrix[i][k]= ((int32_t)calibration.matrix[i][k]*gain + CAL_ONE/2) >> CAL_BITS;
+            if(matrix[i][k]!=(i==k? CAL_ONE: 0))
+                identity= false;
+        }
+        if(calibration.offset[i])
+            identity= false;
+    }
+    // the overflow ISR shows stream frames through calibrate()
+    uint8_t sreg= SREG;
+    cli();
+    memcpy(active.matrix, matrix, sizeof(matrix));
+    memcpy(active.offset, calibration.offset, sizeof(active.offset));
+    active.identity= identity;
+    SREG= sreg;
+}
+
+void calibrate(int16_t *rgb)
+{
+    if(active.identity)
+        return;
+    int16_t in[3]= { rgb[0], rgb[1], rgb[2] };
+    for(uint8_t i= 0; i<3; ++i)
+    {
+        const int16_t *m= active.matrix[i];
+        int32_t x= (int32_t)m[0]*in[0] + (int32_t)m[1]*in[1] + (int32_t)m[2]*in[2];
+        x= ((x + CAL_ONE/2) >> CAL_BITS) + active.offset[i];
+        CLAMP(x, 0, CAL_RGB_MAX);
+        rgb[i]= x;
+    }
+}
+
+// one line per output channel: matrix row and offset; then the white point
+bool calibrationPrint(uint8_t row)
+{
+    if(row<3)
+    {
+        printf_P(PSTR("%d %6d %6d %6d %6d\n"), row, calibration.matrix[row][0], calibration.matrix[row][1],
+                 calibration.matrix[row][2], calibration.offset[row]);
+        return true;
+    }
+    if(row>3)
+        return false;
+    printf_P(PSTR("white %u K, gains %u %u %u\n"), calibration.kelvin, calibrationKelvinGain(calibration.kelvin, 0),
+             calibrationKelvinGain(calibration.kelvin, 1), calibrationKelvinGain(calibration.kelvin, 2));
+    return true;
+}
@@ -0,0 +1,43 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+// color calibration between the color math and the brightness curves: a 3x3
+// matrix on the still encoded RGB values (CIE L* with the default curve, the
+// curves linearize afterwards) plus an offset per channel, so white comes out white
+// with the channels' different resistor networks and the hues are spaced evenly.
+// an optional white point scales the rows to the color of a black body at
+// that temperature. the matrix ledFrameMake() applies has the white point
+// folded in already, and the identity is skipped.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CAL_BITS            12
+#define CAL_ONE             (1<<CAL_BITS)   // 1.0 in the matrix
+#define CAL_LIMIT           (4*CAL_ONE)     // matrix entries are -4.0..4.0
+#define CAL_RGB_MAX         ((1<<14)-1)     // RGB_MAX in lightpainting.c
+#define CAL_KELVIN_MIN      1000
+#define CAL_KELVIN_MAX      12000
+
+struct calibration
+{
+    int16_t matrix[3][3];           // rows are the output channels
+    int16_t offset[3];              // RGB units, added after the matrix
+    uint16_t kelvin;                // white point, 0 for none
+};
+
+extern struct calibration calibration;
+
+// identity, no offsets, no white point
+void calibrationReset(struct calibration *c);
+// bring values from the EEPROM or the serial port into range
+void calibrationLimit(struct calibration *c);
+// make 'calibration' the one ledFrameMake() uses
+void calibrationApply(void);
+// in place, rgb in 0..CAL_RGB_MAX
+void calibrate(int16_t *rgb);
+// gain of a channel at the white point, CAL_ONE for 1.0
+uint16_t calibrationKelvinGain(uint16_t kelvin, uint8_t channel);
+bool calibrationPrint(uint8_t row);     // a listing row, false past the last
+
+#endif //CALIBRATION_H
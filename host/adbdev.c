@@ -0,0 +1,240 @@
+#include <string.h>
+#include "adbdev.h"
+
+#define ATT_MIN         400     // shortest low pulse taken as attention
+#define RESET_MIN       2000    // global reset
+#define BIT_THRESHOLD   50      // low time below this is a 1 bit
+#define BIT_CELL        100     // bit cell length when talking
+#define BIT_SHORT       35
+#define BIT_LONG        65
+#define STOP_TO_START   160     // stop bit end to response start (Tlt)
+#define LISTEN_DONE     200     // host idle this long ends a listen transfer
+#define SRQ_TIME        300     // service request, from the stop bit's falling edge
+
+void adbDevInit(struct adbDevice *dev, uint8_t address)
+{
+    memset(dev, 0, sizeof(*dev));
+    dev->address= dev->defaultAddress= address;
+    dev->handler= 1;
+    dev->srqEnable= 1;
+    dev->random= address*37 + 11;
+    dev->state= ADBDEV_IDLE;
+}
+
+static void busReset(struct adbDevice *dev)
+{
+    dev->state= ADBDEV_IDLE;
+    dev->talk0Pending= dev->touching= 0;
+    dev->address= dev->defaultAddress;
+    dev->handler= 1;
+    dev->srqEnable= 1;
+    dev->collided= 0;
+}
+
+// inverse of adbGetAbsModeData()
+void adbDevTouch(struct adbDevice *dev, uint16_t x, uint16_t y, uint8_t pressure)
+{
+    uint8_t *d= dev->reg[0];
+    if(!pressure)
+    {
+        if(!dev->touching)
+            return;
+        memset(d, 0, ADBDEV_MAXBYTES);
+        dev->touching= 0;
+        dev->talk0Pending= 1;
+        return;
+    }
+    d[0]= ((y>>2) & 0x7F);
+    d[1]= ((x>>2) & 0x7F);
+    d[2]= ((x>>9) & 7) | (((y>>9) & 7) << 4);
+    d[3]= ((x>>12) & 7) | (((y>>12) & 7) << 4);
+    d[4]= ((pressure>>2) & 7) | (((pressure>>5) & 7) << 4);
+    d[5]= d[6]= d[7]= 0;
+    dev->touching= 1;
+    dev->talk0Pending= 1;
+}
+
+static void startResponse(struct adbDevice *dev, const uint8_t *data, uint8_t len, uint32_t now)
+{
+    memcpy(dev->resp, data, len);
+    dev->respLen= len;
+    dev->respStart= now + STOP_TO_START;
+    dev->state= ADBDEV_RESPOND;
+    dev->responses++;
+}
+
+static void command(struct adbDevice *dev, uint32_t now)
+{
+    uint8_t cmd= 0;
+    for(int i= 0; i<8; ++i)
+        cmd= (cmd<<1) | dev->bits[i];
+    dev->commands++;
+    dev->state= ADBDEV_IDLE;
+
+    if((cmd>>4)!=dev->address)
+        return;
+
+    uint8_t reg= cmd & 3;
+    switch((cmd>>2) & 3)
+    {
+        case 3:     // talk
+            dev->talks++;
+            if(reg==0)
+            {
+                if(!dev->talk0Pending)
+                    return;
+                dev->talk0Pending= dev->touching;
+                startResponse(dev, dev->reg[0], ADBDEV_ABSBYTES, now);
+            }
+            else if(reg==3)
+            {
+                // a random address tells identical devices apart
+                dev->random= dev->random*109 + 89;
+                dev->collided= 0;
+                uint8_t r3[2]= { 0x40 | (dev->srqEnable<<5) | ((dev->random>>4) & 0x0F), dev->handler };
+                startResponse(dev, r3, 2, now);
+            }
+            else
+                startResponse(dev, dev->reg[reg], ADBDEV_MAXBYTES, now);
+            break;
+        case 2:     // listen
+            dev->listens++;
+            dev->listenReg= reg;
+            dev->nbits= 0;
+            dev->state= ADBDEV_LISTEN;
+            break;
+        default:    // flush, reset
+            if((cmd & 0x0F)==0)
+                dev->talk0Pending= dev->touching= 0;
+            break;
+    }
+}
+
+static void listenDone(struct adbDevice *dev)
+{
+    uint8_t data[ADBDEV_MAXBYTES]= { 0 };
+    uint8_t nbytes= dev->nbits>2? (dev->nbits-2)/8: 0;
+    for(int i= 0; i<nbytes*8; ++i)
+        data[i/8]|= dev->bits[1+i] << (7-(i&7));
+    dev->state= ADBDEV_IDLE;
+
+    if(dev->listenReg==3)
+    {
+        if(nbytes<2)
+            return;
+        if(data[1]==0xFE)
+        {
+            if(!dev->collided)
+                dev->address= data[0] & 0x0F;
+        }
+        else if(data[1]==0x00)
+            dev->address= data[0] & 0x0F,
+            dev->srqEnable= (data[0]>>5) & 1;
+        else if(data[1]!=0xFD && data[1]!=0xFF)
+            dev->handler= data[1],
+            dev->srqEnable= (data[0]>>5) & 1;
+    }
+    else
+        memcpy(dev->reg[dev->listenReg], data, nbytes);
+}
+
+static void hostPulse(struct adbDevice *dev, uint32_t lowTime, uint32_t now)
+{
+    dev->lastRise= now;
+    if(lowTime>=RESET_MIN)
+    {
+        busReset(dev);
+        return;
+    }
+    if(lowTime>=ATT_MIN)
+    {
+        // the next command can follow a listen sooner than LISTEN_DONE
+        if(dev->state==ADBDEV_LISTEN)
+            listenDone(dev);
+        dev->state= ADBDEV_COMMAND;
+        dev->nbits= 0;
+        return;
+    }
+    if(dev->state!=ADBDEV_COMMAND && dev->state!=ADBDEV_LISTEN)
+        return;
+    if(dev->nbits<ADBDEV_MAXBITS)
+        dev->bits[dev->nbits++]= lowTime<BIT_THRESHOLD;
+    // the low time of the attention signal runs straight into the sync
+    // bit, so a command is 8 bits plus the stop bit
+    if(dev->state==ADBDEV_COMMAND && dev->nbits==9)
+        command(dev, now);
+}
+
+// line level the device drives while responding
+static uint8_t responseLow(struct adbDevice *dev, uint32_t now)
+{
+    if((int32_t)(now-dev->respStart)<0)
+        return 0;
+    uint32_t elapsed= now-dev->respStart;
+    uint32_t bit= elapsed/BIT_CELL, phase= elapsed%BIT_CELL;
+    uint32_t nbits= 2 + dev->respLen*8;
+    if(bit>=nbits)
+    {
+        dev->state= ADBDEV_IDLE;
+        return 0;
+    }
+    uint8_t value;
+    if(bit==0)
+        value= 1;
+    else if(bit==nbits-1)
+        value= 0;
+    else
+        value= (dev->resp[(bit-1)/8] >> (7-((bit-1)&7))) & 1;
+    return phase < (value? BIT_SHORT: BIT_LONG);
+}
+
+// at the falling edge of the stop bit: ask for service if there's a report
+// and the command is for another device
+static void stopBit(struct adbDevice *dev, uint32_t now)
+{
+    uint8_t address= 0;
+    for(int i= 0; i<4; ++i)
+        address= (address<<1) | dev->bits[i];
+    if(dev->talk0Pending && dev->srqEnable && address!=dev->address)
+        dev->srqUntil= now + SRQ_TIME,
+        dev->srqs++;
+}
+
+uint8_t adbDevUpdate(struct adbDevice *dev, uint32_t nowUs, uint8_t lineLow)
+{
+    uint8_t driving= 0;
+    if(dev->state==ADBDEV_RESPOND)
+    {
+        driving= responseLow(dev, nowUs);
+        // wanted the line high but someone else holds it low: stop talking
+        if(!driving && lineLow && dev->state==ADBDEV_RESPOND && (int32_t)(nowUs-dev->respStart)>=0)
+        {
+            dev->state= ADBDEV_IDLE;
+            dev->collided= 1;
+            dev->collisions++;
+        }
+        if(lineLow && !dev->lineWasLow)
+            dev->lowSince= nowUs;
+        dev->lineWasLow= lineLow;
+        return driving;
+    }
+
+    if(lineLow && !dev->lineWasLow)
+    {
+        dev->lowSince= nowUs;
+        if(dev->state==ADBDEV_COMMAND && dev->nbits==8)
+            stopBit(dev, nowUs);
+    }
+    else if(!lineLow && dev->lineWasLow)
+        hostPulse(dev, nowUs-dev->lowSince, nowUs);
+    dev->lineWasLow= lineLow;
+
+    if(dev->state==ADBDEV_LISTEN && !lineLow && nowUs-dev->lastRise>LISTEN_DONE)
+        listenDone(dev);
+
+    if(dev->state==ADBDEV_RESPOND)
+        driving= responseLow(dev, nowUs);
+    if((int32_t)(nowUs-dev->srqUntil)<0)
+        driving= 1;
+    return driving;
+}
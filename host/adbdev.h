@@ -0,0 +1,57 @@
+// behavioural model of an ADB device on the bus (TM1001A touchpad in absolute mode).
+// the model only sees the line level everyone else drives and the time in microseconds,
+// so it can sit behind the register mocks of the host build or any other simulator.
+// several of them share a line: one that has a report but isn't addressed holds the
+// stop bit low (service request), and one that finds the line low when it wants it
+// high while talking stops and keeps its address on the next 'move if no collision'.
+#ifndef ADBDEV_H
+#define ADBDEV_H
+
+#include <stdint.h>
+
+#define ADBDEV_MAXBYTES     8
+#define ADBDEV_MAXBITS      (2+ADBDEV_MAXBYTES*8)
+#define ADBDEV_ABSBYTES     5       // length of an absolute mode report
+
+enum adbDevState
+{
+    ADBDEV_IDLE,        // waiting for attention
+    ADBDEV_COMMAND,     // receiving command byte and stop bit
+    ADBDEV_LISTEN,      // receiving data from the host
+    ADBDEV_RESPOND,     // driving a talk response
+};
+
+struct adbDevice
+{
+    uint8_t address;                            // current bus address
+    uint8_t handler;                            // handler id, low byte of register 3
+    uint8_t defaultAddress;                     // after power-on and bus reset
+    uint8_t srqEnable;                          // register 3 bit 13
+    uint8_t collided;                           // lost the line in the last talk
+    uint8_t random;                             // for the address field of a register 3 talk
+    uint8_t reg[4][ADBDEV_MAXBYTES];
+    uint8_t talk0Pending;                       // register 0 holds a report the host hasn't fetched
+    uint8_t touching;                           // finger is on the pad, keep reporting
+
+    enum adbDevState state;
+    uint8_t lineWasLow;
+    uint32_t lowSince, lastRise;                // host pulse timing
+    uint32_t srqUntil;                          // holding the line for a service request
+    uint8_t bits[ADBDEV_MAXBITS];
+    uint8_t nbits;
+    uint8_t listenReg;
+    uint8_t resp[ADBDEV_MAXBYTES];              // talk response being sent
+    uint8_t respLen;
+    uint32_t respStart;
+
+    uint32_t commands, talks, responses, listens, srqs, collisions;
+};
+
+void adbDevInit(struct adbDevice *dev, uint8_t address);
+// put a finger on the pad (pressure>0) or lift it (pressure==0)
+void adbDevTouch(struct adbDevice *dev, uint16_t x, uint16_t y, uint8_t pressure);
+// advance the model to nowUs with the host or another device driving the line low or not.
+// returns nonzero while the device pulls the line low.
+uint8_t adbDevUpdate(struct adbDevice *dev, uint32_t nowUs, uint8_t lineLow);
+
+#endif //ADBDEV_H
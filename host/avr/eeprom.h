@@ -0,0 +1,20 @@
+#ifndef HOST_AVR_EEPROM_H
+#define HOST_AVR_EEPROM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <avr/io.h>
+
+// EEPROM image and write timing live in sim.c. addresses are pointers like in
+// avr-libc, counted from 0.
+extern uint8_t simEeprom[E2END+1];
+extern uint32_t simEepromWrites;            // bytes actually programmed
+
+int eeprom_is_ready(void);
+uint8_t eeprom_read_byte(const uint8_t *addr);
+uint16_t eeprom_read_word(const uint16_t *addr);
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_write_byte(uint8_t *addr, uint8_t value);
+void eeprom_update_byte(uint8_t *addr, uint8_t value);
+
+#endif //HOST_AVR_EEPROM_H
@@ -0,0 +1,33 @@
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+void simCli(void);
+void simSei(void);
+
+#define cli()       simCli()
+#define sei()       simSei()
+
+// vectors are ordinary functions which sim.c calls when the flag and enable bits allow it.
+// unused ones have weak empty definitions there. ISR_NOBLOCK sets the I flag on entry
+// like the avr-libc attribute does.
+#define ISR_BLOCK
+#define ISR_NOBLOCK         | 1
+#define ISR(vector, ...)                                \
+    static void vector##_body(void);                    \
+    void vector(void)                                   \
+    {                                                   \
+        if(0 __VA_ARGS__) sei();                        \
+        vector##_body();                                \
+    }                                                   \
+    static void vector##_body(void)
+
+void INT0_vect(void);
+void INT6_vect(void);
+void PCINT0_vect(void);
+void USB_GEN_vect(void);
+void TIMER1_OVF_vect(void);
+void TIMER0_COMPA_vect(void);
+
+#endif //HOST_AVR_INTERRUPT_H
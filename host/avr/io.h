@@ -0,0 +1,121 @@
+// host build: register file of the ATmega32u4 as plain variables.
+// only what the firmware actually touches is declared here; the
+// peripheral behaviour behind it lives in sim.c.
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+#include <stdint.h>
+
+#define _BV(bit)    (1<<(bit))
+
+extern volatile uint8_t SREG;
+#define SREG_I      7
+
+// ports
+extern volatile uint8_t PINB, DDRB, PORTB;
+extern volatile uint8_t PINC, DDRC, PORTC;
+extern volatile uint8_t PIND, DDRD, PORTD;
+extern volatile uint8_t PINE, DDRE, PORTE;
+extern volatile uint8_t PINF, DDRF, PORTF;
+
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+
+// timer0 -- the counter advances the virtual clock when read, so busy loops terminate
+extern volatile uint8_t TCCR0A, TCCR0B;
+volatile uint8_t *simTimer0Counter(void);
+#define TCNT0       (*simTimer0Counter())
+
+extern volatile uint8_t TIMSK0, TIFR0, OCR0A;
+
+#define CS00    0
+#define CS01    1
+#define CS02    2
+#define OCIE0A  1
+#define OCF0A   1
+
+// timer1
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern volatile uint16_t TCNT1, ICR1, OCR1A, OCR1B;
+
+#define WGM10   0
+#define WGM11   1
+#define COM1B0  4
+#define COM1B1  5
+#define COM1A0  6
+#define COM1A1  7
+#define CS10    0
+#define CS11    1
+#define CS12    2
+#define WGM12   3
+#define WGM13   4
+#define TOIE1   0
+#define TOV1    0
+
+// timer3
+extern volatile uint8_t TCCR3A, TCCR3B, TIMSK3;
+extern volatile uint16_t TCNT3, ICR3, OCR3A;
+
+#define WGM30   0
+#define WGM31   1
+#define COM3A0  6
+#define COM3A1  7
+#define CS30    0
+#define CS31    1
+#define CS32    2
+#define WGM32   3
+#define WGM33   4
+
+// external interrupts
+extern volatile uint8_t EICRA, EICRB, EIMSK, EIFR;
+
+#define ISC00   0
+#define ISC01   1
+#define ISC60   4
+#define ISC61   5
+#define INT0    0
+#define INT6    6
+#define INTF0   0
+#define INTF6   6
+
+// general timer/counter control, the prescaler is shared by timer0, 1 and 3
+extern volatile uint8_t GTCCR;
+
+#define PSRSYNC 0
+#define TSM     7
+
+// pin change interrupts
+extern volatile uint8_t PCICR, PCIFR, PCMSK0;
+
+#define PCIE0   0
+#define PCIF0   0
+#define PCINT0  0
+#define PCINT1  1
+#define PCINT2  2
+#define PCINT3  3
+#define PCINT4  4
+#define PCINT5  5
+#define PCINT6  6
+#define PCINT7  7
+
+// USB device interrupts; only the start of frame one is simulated, once per millisecond
+extern volatile uint8_t UDIEN;
+
+#define SOFE    2
+#define SOFI    2
+
+// interrupt flag registers are write-one-to-clear on the chip; here the firmware's
+// writes are collected in TIFRn/PCIFR and applied by the simulator on its next step
+
+// misc
+extern volatile uint8_t MCUSR;
+#define WDRF    3
+#define E2END   0x3FF
+
+#endif //HOST_AVR_IO_H
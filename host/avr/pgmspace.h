@@ -0,0 +1,19 @@
+#ifndef HOST_AVR_PGMSPACE_H
+#define HOST_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+// one address space on the host
+#define PROGMEM
+#define PSTR(s)                 (s)
+#define pgm_read_byte(addr)     (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)     (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr)    (*(const uint32_t *)(addr))
+#define memcpy_P                memcpy
+#define strcmp_P                strcmp
+#define strcpy_P                strcpy
+#define strncpy_P               strncpy
+#define printf_P                printf
+
+#endif //HOST_AVR_PGMSPACE_H
@@ -0,0 +1,7 @@
+#ifndef HOST_AVR_POWER_H
+#define HOST_AVR_POWER_H
+
+#define clock_div_1     0
+#define clock_prescale_set(div)
+
+#endif //HOST_AVR_POWER_H
@@ -0,0 +1,13 @@
+#ifndef HOST_AVR_SLEEP_H
+#define HOST_AVR_SLEEP_H
+
+void simSleep(void);
+
+#define SLEEP_MODE_IDLE         0
+#define set_sleep_mode(mode)
+#define sleep_enable()
+#define sleep_disable()
+// runs the simulated board until an interrupt handler has run
+#define sleep_cpu()             simSleep()
+
+#endif //HOST_AVR_SLEEP_H
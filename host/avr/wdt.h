@@ -0,0 +1,7 @@
+#ifndef HOST_AVR_WDT_H
+#define HOST_AVR_WDT_H
+
+#define wdt_disable()
+#define wdt_reset()
+
+#endif //HOST_AVR_WDT_H
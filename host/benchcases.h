@@ -0,0 +1,92 @@
+// the hot color and input paths, timed natively by 'lpsim -b' (ns per call) and
+// on the AVR by simavr/bench.c under lpavr -B (cycles per call). both check
+// the averages against the budgets in bench.budget.
+//
+// BENCH_CASE(name, body): body is one call, 'i' counts the calls. the state
+// comes from benchSetup(): presets 1 and 2 held, so a transition is running,
+// and a calibration with cross terms and a white point, as on a tuned lamp.
+// the OKLab cases use red, blue and a color halfway from blue to yellow in
+// OKLCh that is outside the gamut, which oklabToRgb() has to bring back.
+#ifndef BENCHCASES_H
+#define BENCHCASES_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef BENCH_NAMES_ONLY
+#include "lightpainting.h"
+#include "adbabs.h"
+#include "calibration.h"
+#include "oklab.h"
+
+void hsv2rgb(int h, int s, int v, uint16_t *dest);
+uint16_t hueLerp(int32_t a, int32_t b, uint16_t offset);
+void transitionColor(struct ledFrame *frame);
+uint8_t extractSingleButton(uint8_t mask);
+uint8_t countBits(uint8_t mask);
+void buttonChange(uint8_t lastButtons, uint8_t buttons);
+void ProcessCDCChar(uint8_t c);
+
+static volatile uint16_t benchSink;
+static uint16_t benchRgb[3];
+static struct ledFrame benchFrame;
+static struct adbAbsMode benchAbs;
+static int16_t benchCal[3];
+static int16_t benchLab[4][3];
+static const uint8_t benchAdb[5]= { 0x3A, 0x7C, 0x25, 0x10, 0x32 };
+// a binary RGB frame, see ProcessStreamFrame(), with a valid CRC
+static const uint8_t benchStream[10]= { 0xA5, 0x00, 0x00, 0x00, 0x10, 0x00, 0x08, 0x00, 0x04, 0x7F };
+
+static void benchSetup(void)
+{
+    buttonChange(0, 0);
+    buttonChange(0, 3);
+    calibrationReset(&calibration);
+    calibration.matrix[0][0]= 3400;
+    calibration.matrix[1][0]= 180;
+    calibration.matrix[1][1]= 3900;
+    calibration.matrix[2][1]= -120;
+    calibration.offset[2]= 40;
+    calibration.kelvin= 5000;
+    calibrationApply();
+    const uint16_t red[3]= { 0x3FFF, 0, 0 }, blue[3]= { 0, 0, 0x3FFF }, yellow[3]= { 0x3FFF, 0x3FFF, 0 };
+    oklabFromRgb(red, benchLab[0]);
+    oklabFromRgb(blue, benchLab[1]);
+    oklabFromRgb(yellow, benchLab[3]);
+    oklabLerp(benchLab[1], benchLab[3], 1<<(OKLAB_LERP_BITS-1), true, benchLab[2]);
+}
+#endif
+
+#define BENCH_CASES                                                                         \
+    BENCH_CASE(hsv2rgb, hsv2rgb(i*7 & 0x3FFF, (i>>3) & 0x3FFF, (i>>5) & 0x3FFF, benchRgb))  \
+    BENCH_CASE(hueLerp, benchSink= hueLerp(i*13 & 0x3FFF, (i*29+8000) & 0x3FFF, i & 0x7FFF)) \
+    BENCH_CASE(transitionColor, transitionColor(&benchFrame))                               \
+    BENCH_CASE(adbGetAbsModeData, adbGetAbsModeData(&benchAbs, benchAdb))                   \
+    BENCH_CASE(extractSingleButton, benchSink= extractSingleButton(i & 15))                 \
+    BENCH_CASE(countBits, benchSink= countBits(i))                                          \
+    BENCH_CASE(ProcessCDCChar, ProcessCDCChar(benchStream[i%10]))                           \
+    BENCH_CASE(calibrate, (benchCal[0]= i*7 & 0x3FFF, benchCal[1]= i*3 & 0x3FFF, benchCal[2]= i & 0x3FFF, \
+                           calibrate(benchCal)))                                            \
+    BENCH_CASE(oklabFromRgb, (benchRgb[0]= i*7 & 0x3FFF, benchRgb[1]= i*3 & 0x3FFF, benchRgb[2]= i & 0x3FFF, \
+                              oklabFromRgb(benchRgb, benchLab[3])))                         \
+    BENCH_CASE(oklabLerp, oklabLerp(benchLab[0], benchLab[1], i & 0x7FFF, true, benchLab[3])) \
+    BENCH_CASE(oklabToRgb, oklabToRgb(benchLab[i%3], benchRgb))
+
+// budget for 'name' from the file, column 0 host ns, 1 AVR cycles; -1 if there is none
+static long benchBudget(const char *file, const char *name, int column)
+{
+    FILE *f= fopen(file, "r");
+    char line[128], n[32], budget[2][16];
+    long ret= -1;
+    if(!f)
+        return -1;
+    while(fgets(line, sizeof(line), f))
+        if(line[0]!='#' && sscanf(line, "%31s %15s %15s", n, budget[0], budget[1])==3 && !strcmp(n, name))
+            ret= strcmp(budget[column], "-")? atol(budget[column]): -1;
+    fclose(f);
+    return ret;
+}
+
+#endif //BENCHCASES_H
@@ -0,0 +1,431 @@
+// host driver for the firmware: runs setup() and the main loop against the
+// simulated board, driven by a script, and/or benchmarks the hot paths.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <util/crc16.h>
+#include <avr/eeprom.h>
+#include "main.h"
+#include "stats.h"
+#include "sched.h"
+#include "serial.h"
+#include "trace.h"
+#include "vendor.h"
+#include "benchcases.h"
+
+// firmware internals not exported through lightpainting.h
+void setLEDsHSV(uint16_t h, uint16_t s, uint16_t v);
+void buttonChange(uint8_t lastButtons, uint8_t buttons);
+
+// stand-in for the time the CDC endpoint service takes per USB frame
+#define USB_FRAME_CYCLES    300
+#define USB_PACKET          64      // CDC_TXRX_EPSIZE
+// one pass through schedRun() when nothing is due
+#define LOOP_IDLE_CYCLES    40
+
+#define HSV_MAX             ((1<<14)-1)     // as in lightpainting.c
+
+static FILE *hostOut;                       // the real stdout, the firmware's goes through serial.c
+static FILE *dutyOut;
+static const char *eepromFile;
+static const char *budgetFile;              // -B
+static int overBudget;
+static uint8_t cdcInput[256];               // bytes the host has sent over the virtual serial port
+static int cdcInputLen, cdcInputPos;
+static uint8_t vendorOut[VENDOR_EPSIZE];    // OUT packet for the vendor interface
+static int vendorOutLen= -1;                // -1 when the endpoint took it
+static struct vendorReport vendorIn;        // the last report fetched from it
+
+static void dutyChanged(void)
+{
+    fprintf(dutyOut, "%lu %u %u %u\n", (unsigned long)simMicros(), simDuty[0], simDuty[1], simDuty[2]);
+}
+
+// CDCTask() in lufa/main.c
+static void cdcTask(void)
+{
+    int16_t c;
+    while(!ProcessCDCListing() && (c= serialGet())>=0)
+        ProcessCDCChar(c);
+}
+
+// EVENT_USB_Device_StartOfFrame() and CDCService() in lufa/main.c, with the host on
+// the other end: one packet of the pending input in, one packet of output out.
+// the other USB interrupts stay masked during the pass, there is no USB_COM here
+ISR(USB_GEN_vect)
+{
+    uint8_t deviceInterrupts= UDIEN;
+    UDIEN= 0;
+    sei();
+    STATS_BEGIN(STATS_USB_FRAME);
+    serialFrame();
+    serialConnected= 1;
+    int n= cdcInputLen-cdcInputPos;
+    if(n>USB_PACKET)
+        n= USB_PACKET;
+    if(n<=serialRxFree())
+        while(n--)
+            serialRxPut(cdcInput[cdcInputPos++]);
+    int16_t c;
+    for(n= 0; n<USB_PACKET && (c= serialTxGet())>=0; ++n)
+        fputc(c, hostOut);
+    // VendorService()
+    uint8_t *packet;
+    if(vendorOutLen>=0 && (packet= vendorRxSlot()))
+    {
+        memcpy(packet, vendorOut, vendorOutLen);
+        vendorRxPut(vendorOutLen);
+        vendorOutLen= -1;
+    }
+    const struct vendorReport *report= vendorTxGet();
+    if(report)
+        vendorIn= *report;
+    simAdvance(USB_FRAME_CYCLES);
+    STATS_END(STATS_USB_FRAME);
+    cli();
+    UDIEN= deviceInterrupts;
+}
+
+static ssize_t firmwareWrite(void *cookie, const char *buf, size_t size)
+{
+    for(size_t i= 0; i<size; ++i)
+        serialPutChar(buf[i], stdout);
+    return size;
+}
+
+// one iteration of the for(;;) in lufa/main.c
+static void loopOnce(void)
+{
+    schedRun();
+    simAdvance(LOOP_IDLE_CYCLES);
+    schedSleep();
+}
+
+static void cdcSend(const uint8_t *data, int len)
+{
+    memcpy(cdcInput, data, len);
+    cdcInputLen= len;
+    cdcInputPos= 0;
+    // the USB frames take it in, the cdc task works through it and the replies go out
+    while(cdcInputPos<cdcInputLen || !serialIdle())
+        loopOnce();
+}
+
+// the vendor interface's OUT endpoint takes it with the next frame, the vendor task works through it
+static void vendorSendPacket(const uint8_t *data, int len)
+{
+    memcpy(vendorOut, data, len);
+    vendorOutLen= len;
+    while(vendorOutLen>=0)
+        loopOnce();
+}
+
+// binary color frame as described at ProcessStreamFrame()
+static void makeFrame(uint8_t *f, uint8_t type, uint16_t c0, uint16_t c1, uint16_t c2)
+{
+    static uint8_t seq;
+    uint8_t frame[10]= { 0xA5, seq++, type, c0, c0>>8, c1, c1>>8, c2, c2>>8, 0 };
+    for(int i= 1; i<9; ++i)
+        frame[9]= _crc8_ccitt_update(frame[9], frame[i]);
+    memcpy(f, frame, sizeof(frame));
+}
+
+static void sendFrame(uint8_t type, uint16_t c0, uint16_t c1, uint16_t c2)
+{
+    uint8_t f[10];
+    makeFrame(f, type, c0, c1, c2);
+    cdcSend(f, sizeof(f));
+}
+
+static void runFor(uint32_t us)
+{
+    uint64_t end= simCycles + (uint64_t)us*SIM_CYCLES_PER_US;
+    while(simCycles<end)
+        loopOnce();
+}
+
+static void setButtons(uint8_t mask, uint32_t bounceUs)
+{
+    static uint8_t last;
+    // toggle the changed contacts a few times before they settle
+    for(int i= 0; i<4 && bounceUs; ++i)
+    {
+        simSetButtons(i&1? last: mask);
+        runFor(bounceUs/4);
+    }
+    simSetButtons(mask);
+    last= mask;
+}
+
+// feed a trace written by lptrace to the firmware, each record at its time after
+// the previous one. the simulated touchpad is left alone, its empty reports
+// don't get in the way of the recorded ones
+static int replay(const char *name)
+{
+    FILE *f= fopen(name, "rb");
+    uint8_t record[TRACE_MAX_RECORD];
+    char magic[4];
+    if(!f || fread(magic, 1, 4, f)!=4 || memcmp(magic, TRACE_FILE_MAGIC, 4))
+    {
+        fprintf(stderr, "%s: not a trace file\n", name);
+        if(f)
+            fclose(f);
+        return 1;
+    }
+    uint16_t last= schedTime();
+    while(fread(record, 1, 4, f)==4)
+    {
+        uint8_t len= traceRecordLength(record);
+        if(!len || fread(record+4, 1, len-4, f)!=len-4)
+        {
+            fprintf(stderr, "%s: bad record at %ld\n", name, ftell(f));
+            fclose(f);
+            return 1;
+        }
+        uint16_t ticks= traceRecordTicks(record);
+        while((uint16_t)(schedTime()-last)<ticks)
+            loopOnce();
+        last+= ticks;
+        traceReplay(record);
+    }
+    fclose(f);
+    return 0;
+}
+
+// script commands, one per line:
+//  wait <ms>                       run the main loop
+//  buttons <mask> [bounce_us]      set held buttons, bit n = button n; the changed contacts
+//                                  bounce for the given time
+//  pad <n>                         the following touch/drag/release go to pad n (see -p)
+//  touch <x> <y> [pressure]        put a finger on the pad
+//  drag <x0> <y0> <x1> <y1> <ms>   move a finger linearly, one sample per ms
+//  release                         lift the finger
+//  cdc <text>                      send a line over the virtual serial port
+//  frame <type> <c0> <c1> <c2>     send a binary color frame, type 0 RGB, 1 HSV
+//  raw <type> <c0> <c1> <c2> [n]   send n frames (1-6) in one packet over the vendor interface,
+//                                  fading from the color to black
+//  report                          write the last status report from the vendor interface to stdout
+//  print                           write the current duty values to stdout
+//  replay <file>                   play back a trace recorded with 'trace 1' and lptrace
+static int runScript(FILE *f, const char *name)
+{
+    struct adbDevice *pad= &simAdb[0];
+    char line[256], cdcLine[256];
+    int lineNo= 0;
+    while(fgets(line, sizeof(line), f))
+    {
+        char cmd[32];
+        unsigned a, b, c, d, e;
+        lineNo++;
+        if(line[0]=='#' || sscanf(line, "%31s", cmd)!=1)
+            continue;
+        if(!strcmp(cmd, "wait") && sscanf(line, "%*s %u", &a)==1)
+            runFor(a*1000);
+        else if(!strcmp(cmd, "buttons") && sscanf(line, "%*s %i", (int *)&a)==1)
+        {
+            if(sscanf(line, "%*s %*i %u", &b)!=1)
+                b= 0;
+            setButtons(a, b);
+        }
+        else if(!strcmp(cmd, "pad") && sscanf(line, "%*s %u", &a)==1 && a<simAdbCount)
+            pad= &simAdb[a];
+        else if(!strcmp(cmd, "touch") && sscanf(line, "%*s %u %u", &a, &b)==2)
+        {
+            if(sscanf(line, "%*s %*u %*u %u", &c)!=1)
+                c= 100;
+            adbDevTouch(pad, a, b, c);
+        }
+        else if(!strcmp(cmd, "drag") && sscanf(line, "%*s %u %u %u %u %u", &a, &b, &c, &d, &e)==5)
+        {
+            for(unsigned i= 0; i<=e; ++i)
+            {
+                int x= (int)a + ((int)c-(int)a)*(int)i/(int)(e? e: 1),
+                    y= (int)b + ((int)d-(int)b)*(int)i/(int)(e? e: 1);
+                adbDevTouch(pad, x, y, 100);
+                runFor(1000);
+            }
+        }
+        else if(!strcmp(cmd, "release"))
+            adbDevTouch(pad, 0, 0, 0);
+        else if(!strcmp(cmd, "cdc") && sscanf(line, "%*s %250[^\n]", cdcLine)==1)
+        {
+            strcat(cdcLine, "\n");
+            cdcSend((uint8_t *)cdcLine, strlen(cdcLine));
+        }
+        else if(!strcmp(cmd, "frame") && sscanf(line, "%*s %u %u %u %u", &a, &b, &c, &d)==4)
+            sendFrame(a, b, c, d);
+        else if(!strcmp(cmd, "raw") && sscanf(line, "%*s %u %u %u %u", &a, &b, &c, &d)==4)
+        {
+            // e frames in one packet, from the color given towards black
+            uint8_t packet[VENDOR_EPSIZE];
+            if(sscanf(line, "%*s %*u %*u %*u %*u %u", &e)!=1)
+                e= 1;
+            if(e<1 || e>VENDOR_FRAMES)
+                e= VENDOR_FRAMES;
+            for(unsigned i= 0; i<e; ++i)
+                makeFrame(packet+i*10, a, b*(e-i)/e, c*(e-i)/e, d*(e-i)/e);
+            vendorSendPacket(packet, e*10);
+        }
+        else if(!strcmp(cmd, "report"))
+            fprintf(hostOut, "report %u t %u rgb %d %d %d duty %u %u %u/%u frames %u crc %u lost %u overruns %u "
+                    "packets %u stall frames %u buttons %u held %u\n", vendorIn.sequence, vendorIn.time,
+                    vendorIn.rgb[0], vendorIn.rgb[1], vendorIn.rgb[2], vendorIn.duty[0], vendorIn.duty[1],
+                    vendorIn.duty[2], vendorIn.top, vendorIn.frames, vendorIn.crcErrors, vendorIn.lost,
+                    vendorIn.overruns, vendorIn.packets, vendorIn.stallFrames, vendorIn.buttons, vendorIn.transitions);
+        else if(!strcmp(cmd, "replay") && sscanf(line, "%*s %250s", cdcLine)==1)
+        {
+            if(replay(cdcLine))
+                return 1;
+        }
+        else if(!strcmp(cmd, "print"))
+            fprintf(hostOut, "%lu %u %u %u\n", (unsigned long)simMicros(), simDuty[0], simDuty[1], simDuty[2]);
+        else
+        {
+            fprintf(stderr, "%s:%d: bad command: %s", name, lineNo, line);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+#define BENCH(label, n, body)                                           \
+{                                                                       \
+    double t0= nowSeconds();                                            \
+    for(uint32_t i= 0; i<(n); ++i) { body; }                            \
+    double dt= nowSeconds()-t0;                                         \
+    benchReport(label, dt*1e9/(n), (n)/dt);                             \
+}
+
+static void benchReport(const char *label, double ns, double rate)
+{
+    long budget= budgetFile? benchBudget(budgetFile, label, 0): -1;
+    fprintf(hostOut, "%-20s %10.1f ns/call %12.0f calls/s", label, ns, rate);
+    if(budget>=0)
+        fprintf(hostOut, "  budget %5ld%s", budget, ns>budget? "  OVER": "");
+    fputc('\n', hostOut);
+    if(budget>=0 && ns>budget)
+        overBudget++;
+}
+
+static void bench(uint32_t n)
+{
+    // two buttons held: the overflow ISR interpolates between presets
+    simSetButtons(0x03);
+    runFor(5000);
+    BENCH("TIMER1_OVF_vect", n, TIMER1_OVF_vect());
+    BENCH("setLEDsHSV", n, setLEDsHSV(i*7, (i>>3)&HSV_MAX, (i>>5)&HSV_MAX));
+    simSetButtons(0);
+    runFor(5000);
+    adbDevTouch(&simAdb[0], 3000, 2000, 100);
+    BENCH("main loop (touching)", n/10, loopOnce());
+    adbDevTouch(&simAdb[0], 0, 0, 0);
+    BENCH("main loop (idle)", n/10, loopOnce());
+
+    // the functions on their own, with nobody on the serial port
+    serialConnected= 0;
+    benchSetup();
+#define BENCH_CASE(name, body)  BENCH(#name, n, body)
+    BENCH_CASES
+#undef BENCH_CASE
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-o dutyfile] [-e eeprom] [-p pads] [-b iterations [-B budgets]] [script...]\n"
+                    "  -o FILE  write 'time_us r g b' whenever the latched PWM duty changes ('-' for stdout)\n"
+                    "  -e FILE  EEPROM image, loaded before setup() if it exists and saved on exit\n"
+                    "  -p N     N touchpads on the ADB line, all at address 3 after power-on (default 1)\n"
+                    "  -b N     benchmark the ISR, the main loop and the functions in benchcases.h with N iterations\n"
+                    "  -B FILE  fail if a benchmark takes longer than its budget in FILE (see bench.budget)\n", argv0);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t benchIterations= 0;
+    int opt;
+    hostOut= stdout;
+    stdout= fopencookie(NULL, "w", (cookie_io_functions_t){ .write= firmwareWrite });
+    setvbuf(stdout, NULL, _IONBF, 0);
+    while((opt= getopt(argc, argv, "o:e:p:b:B:h"))!=-1)
+    {
+        switch(opt)
+        {
+            case 'o':
+                dutyOut= strcmp(optarg, "-")? fopen(optarg, "w"): hostOut;
+                if(!dutyOut)
+                    perror(optarg), exit(1);
+                break;
+            case 'e':
+                eepromFile= optarg;
+                break;
+            case 'p':
+                simAdbCount= atoi(optarg);
+                if(simAdbCount<1 || simAdbCount>SIM_ADB_MAX)
+                    usage(argv[0]);
+                break;
+            case 'b':
+                benchIterations= strtoul(optarg, NULL, 0);
+                break;
+            case 'B':
+                budgetFile= optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if(dutyOut)
+        simDutyHook= dutyChanged;
+    if(eepromFile)
+    {
+        FILE *f= fopen(eepromFile, "rb");
+        if(f)
+            fread(simEeprom, 1, sizeof(simEeprom), f),
+            fclose(f);
+    }
+
+    schedAdd("cdc", cdcTask, SCHED_MS(1));
+    setup();
+    UDIEN|= 1<<SOFE;                        // EVENT_USB_Device_ConfigurationChanged()
+    GlobalInterruptEnable();
+
+    for(int i= optind; i<argc; ++i)
+    {
+        FILE *f= strcmp(argv[i], "-")? fopen(argv[i], "r"): stdin;
+        if(!f)
+            perror(argv[i]), exit(1);
+        if(runScript(f, argv[i]))
+            return 1;
+        if(f!=stdin)
+            fclose(f);
+    }
+
+    if(benchIterations)
+        bench(benchIterations);
+    if(overBudget)
+    {
+        fprintf(stderr, "%d benchmarks over budget\n", overBudget);
+        return 1;
+    }
+
+    if(eepromFile)
+    {
+        FILE *f= fopen(eepromFile, "wb");
+        if(!f || fwrite(simEeprom, 1, sizeof(simEeprom), f)!=sizeof(simEeprom))
+            perror(eepromFile), exit(1);
+        fclose(f);
+    }
+
+    return 0;
+}
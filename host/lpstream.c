@@ -0,0 +1,78 @@
+// streams binary color frames (see ProcessStreamFrame() in lightpainting.c)
+// to the lamp at a fixed rate. reads one color per line from stdin:
+// "r g b" (14-bit each), or "h s v" with -H.
+//
+//  lpstream -r 1000 /dev/ttyACM0 < colors.txt
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <termios.h>
+#include <unistd.h>
+#include <util/crc16.h>
+
+static void addNs(struct timespec *t, long ns)
+{
+    t->tv_nsec+= ns;
+    while(t->tv_nsec>=1000000000)
+        t->tv_nsec-= 1000000000, t->tv_sec++;
+}
+
+int main(int argc, char *argv[])
+{
+    int rate= 1000, type= 0, opt;
+    while((opt= getopt(argc, argv, "r:H"))!=-1)
+    {
+        switch(opt)
+        {
+            case 'r': rate= atoi(optarg); break;
+            case 'H': type= 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-r frames-per-second] [-H] tty < colors\n", argv[0]);
+                return 1;
+        }
+    }
+    if(optind>=argc || rate<=0)
+    {
+        fprintf(stderr, "usage: %s [-r frames-per-second] [-H] tty < colors\n", argv[0]);
+        return 1;
+    }
+
+    int fd= open(argv[optind], O_WRONLY | O_NOCTTY);
+    if(fd<0)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+    struct termios tio;
+    if(!tcgetattr(fd, &tio))
+    {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    uint8_t seq= 0;
+    unsigned c0, c1, c2;
+    char line[128];
+    while(fgets(line, sizeof(line), stdin))
+    {
+        if(sscanf(line, "%u %u %u", &c0, &c1, &c2)!=3)
+            continue;
+        uint8_t f[10]= { 0xA5, seq++, type, c0, c0>>8, c1, c1>>8, c2, c2>>8, 0 };
+        for(int i= 1; i<9; ++i)
+            f[9]= _crc8_ccitt_update(f[9], f[i]);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        if(write(fd, f, sizeof(f))!=sizeof(f))
+        {
+            perror("write");
+            return 1;
+        }
+        addNs(&next, 1000000000L/rate);
+    }
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,117 @@
+// records an input trace (see trace.h) from the lamp into a file for
+// 'replay' in lpsim. on a tty it switches recording on, and off again on ^C;
+// anything else is read as a saved capture of the serial output. text the
+// firmware prints in between goes to stderr.
+//
+//  lptrace /dev/ttyACM0 session.lpt
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include "trace.h"
+
+static volatile sig_atomic_t stop;
+
+static void onSignal(int sig)
+{
+    stop= 1;
+}
+
+// buffered read of one byte, -1 at the end or on ^C
+static int readByte(int fd)
+{
+    static uint8_t buf[256];
+    static int len, pos;
+    while(pos>=len)
+    {
+        if(stop)
+            return -1;
+        len= read(fd, buf, sizeof(buf));
+        pos= 0;
+        if(len<=0 && !stop)
+            return -1;
+        if(len<0)
+            len= 0;
+    }
+    return buf[pos++];
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc!=3)
+    {
+        fprintf(stderr, "usage: %s tty|capture tracefile\n", argv[0]);
+        return 1;
+    }
+    int fd= strcmp(argv[1], "-")? open(argv[1], O_RDWR | O_NOCTTY): 0;
+    if(fd<0)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    FILE *out= fopen(argv[2], "wb");
+    if(!out)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+    int tty= isatty(fd);
+    if(tty)
+    {
+        struct termios tio;
+        if(!tcgetattr(fd, &tio))
+        {
+            cfmakeraw(&tio);
+            tcsetattr(fd, TCSANOW, &tio);
+        }
+        struct sigaction sa= { .sa_handler= onSignal };
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+        write(fd, "trace 1\n", 8);
+        fprintf(stderr, "recording, ^C to stop\n");
+    }
+    fwrite(TRACE_FILE_MAGIC, 1, 4, out);
+
+    uint8_t record[TRACE_MAX_RECORD];
+    unsigned long records= 0;
+    int c;
+    while((c= readByte(fd))>=0)
+    {
+        if((c & 0xF0)!=TRACE_MARK)
+        {
+            fputc(c, stderr);
+            continue;
+        }
+        // the header and the first payload byte tell the length
+        int n= 1, len;
+        record[0]= c;
+        while(n<4 && (c= readByte(fd))>=0)
+            record[n++]= c;
+        if(n<4)
+            break;
+        if(!(len= traceRecordLength(record)))
+        {
+            fprintf(stderr, "lptrace: bad record type %02X, skipped\n", record[0]);
+            continue;
+        }
+        while(n<len && (c= readByte(fd))>=0)
+            record[n++]= c;
+        if(n<len)
+            break;
+        fwrite(record, 1, len, out);
+        records++;
+    }
+
+    if(tty)
+    {
+        write(fd, "trace 0\n", 8);
+        // drop the records still on their way
+        tcflush(fd, TCIFLUSH);
+    }
+    fclose(out);
+    fprintf(stderr, "%lu records\n", records);
+    return 0;
+}
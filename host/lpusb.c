@@ -0,0 +1,181 @@
+// talks to the lamp's vendor interface (see vendor.h): streams binary color
+// frames (see ProcessStreamFrame() in lightpainting.c), one per packet, and/or
+// prints the status reports. uses usbfs directly, so it needs nothing but
+// Linux and write access to the device node; with libusb it's the same
+// libusb_interrupt_transfer() calls on interface 2, endpoints 0x05 and 0x81.
+//
+//  lpusb -r 1000 < colors.txt      one "r g b" line (14-bit each) per frame, "h s v" with -H
+//  lpusb -n -s 100                 print every 100th report, without streaming
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/usbdevice_fs.h>
+#include <util/crc16.h>
+#include "vendor.h"
+
+#define VENDOR_ID           0x03EB      // lufa/Descriptors.c
+#define PRODUCT_ID          0x2044
+#define INTERFACE           2           // INTERFACE_ID_Vendor
+#define OUT_EP              0x05        // VENDOR_OUT_EPADDR
+#define IN_EP               0x81        // VENDOR_IN_EPADDR
+#define TIMEOUT_MS          100
+
+static void addNs(struct timespec *t, long ns)
+{
+    t->tv_nsec+= ns;
+    while(t->tv_nsec>=1000000000)
+        t->tv_nsec-= 1000000000, t->tv_sec++;
+}
+
+// a number from the device's sysfs directory, 'format' is "%x" or "%u"
+static unsigned readAttribute(const char *dir, const char *name, const char *format)
+{
+    char path[512];
+    unsigned v= 0;
+    snprintf(path, sizeof(path), "/sys/bus/usb/devices/%s/%s", dir, name);
+    FILE *f= fopen(path, "r");
+    if(!f)
+        return 0;
+    if(fscanf(f, format, &v)!=1)
+        v= 0;
+    fclose(f);
+    return v;
+}
+
+// usbfs node of the first lamp on the bus, opened read/write; -1 if there is none
+static int openLamp(void)
+{
+    DIR *d= opendir("/sys/bus/usb/devices");
+    struct dirent *e;
+    int fd= -1;
+    if(!d)
+        return -1;
+    while(fd<0 && (e= readdir(d)))
+    {
+        if(readAttribute(e->d_name, "idVendor", "%x")!=VENDOR_ID ||
+           readAttribute(e->d_name, "idProduct", "%x")!=PRODUCT_ID)
+            continue;
+        char node[64];
+        snprintf(node, sizeof(node), "/dev/bus/usb/%03u/%03u", readAttribute(e->d_name, "busnum", "%u"),
+                 readAttribute(e->d_name, "devnum", "%u"));
+        fd= open(node, O_RDWR);
+        if(fd<0)
+            perror(node);
+    }
+    closedir(d);
+    return fd;
+}
+
+// interrupt transfers go through the bulk ioctl, the kernel picks the type from the endpoint
+static int transfer(int fd, unsigned ep, void *data, unsigned length)
+{
+    struct usbdevfs_bulktransfer t= { .ep= ep, .len= length, .timeout= TIMEOUT_MS, .data= data };
+    return ioctl(fd, USBDEVFS_BULK, &t);
+}
+
+static void printReport(const struct vendorReport *r)
+{
+    printf("report %u t %u rgb %d %d %d duty %u %u %u/%u frames %u crc %u lost %u overruns %u "
+           "packets %u stall frames %u buttons %u held %u\n", r->sequence, r->time, r->rgb[0], r->rgb[1], r->rgb[2],
+           r->duty[0], r->duty[1], r->duty[2], r->top, r->frames, r->crcErrors, r->lost, r->overruns,
+           r->packets, r->stallFrames, r->buttons, r->transitions);
+    fflush(stdout);
+}
+
+// reads one report, prints every 'every'th
+static int pollReport(int fd, unsigned every)
+{
+    static unsigned count;
+    uint8_t packet[VENDOR_EPSIZE];
+    int n= transfer(fd, IN_EP, packet, sizeof(packet));
+    if(n<0)
+        return -1;
+    if(n>=(int)sizeof(struct vendorReport) && packet[0]==VENDOR_REPORT_STATUS && !(count++ % every))
+        printReport((const struct vendorReport *)packet);
+    return 0;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-r frames-per-second] [-H] [-s every] [-n] < colors\n"
+                    "  -s  print every n-th status report\n"
+                    "  -n  no color stream, only reports\n", argv0);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int rate= 1000, type= 0, stream= 1, opt;
+    unsigned every= 0;
+    while((opt= getopt(argc, argv, "r:Hs:n"))!=-1)
+    {
+        switch(opt)
+        {
+            case 'r': rate= atoi(optarg); break;
+            case 'H': type= 1; break;
+            case 's': every= strtoul(optarg, NULL, 0); break;
+            case 'n': stream= 0; break;
+            default: usage(argv[0]);
+        }
+    }
+    if(optind!=argc || rate<=0 || rate>1000 || (!stream && !every))
+        usage(argv[0]);
+
+    int fd= openLamp();
+    if(fd<0)
+    {
+        fprintf(stderr, "no lamp (%04x:%04x) found\n", VENDOR_ID, PRODUCT_ID);
+        return 1;
+    }
+    unsigned interface= INTERFACE;
+    if(ioctl(fd, USBDEVFS_CLAIMINTERFACE, &interface)<0)
+    {
+        perror("claim interface");
+        return 1;
+    }
+
+    if(!stream)
+    {
+        while(!pollReport(fd, every))
+            ;
+        perror("report");
+        return 1;
+    }
+
+    // one frame per packet: the lamp shows the newest frame at its next PWM period,
+    // a packet holding several would only show the last one
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    uint8_t seq= 0;
+    unsigned c0, c1, c2;
+    char line[128];
+    while(fgets(line, sizeof(line), stdin))
+    {
+        if(sscanf(line, "%u %u %u", &c0, &c1, &c2)!=3)
+            continue;
+        uint8_t f[10]= { 0xA5, seq++, type, c0, c0>>8, c1, c1>>8, c2, c2>>8, 0 };
+        for(int i= 1; i<9; ++i)
+            f[9]= _crc8_ccitt_update(f[9], f[i]);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        if(transfer(fd, OUT_EP, f, sizeof(f))!=sizeof(f))
+        {
+            perror("send");
+            return 1;
+        }
+        if(every && pollReport(fd, every))
+        {
+            perror("report");
+            return 1;
+        }
+        addNs(&next, 1000000000L/rate);
+    }
+    ioctl(fd, USBDEVFS_RELEASEINTERFACE, &interface);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,23 @@
+// host build stand-in for lufa/main.h: same includes the firmware expects,
+// but backed by the simulated peripherals instead of LUFA.
+#ifndef HOST_MAIN_H
+#define HOST_MAIN_H
+
+#include <avr/io.h>
+#include <avr/wdt.h>
+#include <avr/power.h>
+#include <avr/interrupt.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "lightpainting.h"
+#include "sim.h"
+
+#define Delay_MS(ms)                simDelayMs(ms)
+#define GlobalInterruptEnable()     sei()
+
+void ProcessCDCChar(uint8_t c);
+bool ProcessCDCListing(void);
+
+#endif //HOST_MAIN_H
@@ -0,0 +1,288 @@
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include "sim.h"
+
+volatile uint8_t SREG;
+volatile uint8_t PINB, DDRB, PORTB;
+volatile uint8_t PINC, DDRC, PORTC;
+volatile uint8_t PIND, DDRD, PORTD;
+volatile uint8_t PINE, DDRE, PORTE;
+volatile uint8_t PINF, DDRF, PORTF;
+volatile uint8_t TCCR0A, TCCR0B, TIMSK0, TIFR0, OCR0A;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint16_t TCNT1, ICR1, OCR1A, OCR1B;
+volatile uint8_t TCCR3A, TCCR3B, TIMSK3;
+volatile uint16_t TCNT3, ICR3, OCR3A;
+volatile uint8_t GTCCR;
+volatile uint8_t PCICR, PCIFR, PCMSK0;
+volatile uint8_t EICRA, EICRB, EIMSK, EIFR;
+volatile uint8_t UDIEN;
+volatile uint8_t MCUSR;
+
+uint64_t simCycles;
+struct adbDevice simAdb[SIM_ADB_MAX];
+uint8_t simAdbCount= 1;
+uint16_t simDuty[3];
+uint32_t simTimer1Overflows;
+void (*simDutyHook)(void);
+uint8_t simEeprom[E2END+1];
+uint32_t simEepromWrites;
+
+static volatile uint8_t tcnt0;
+static uint8_t flags0, flags1, pcFlags, intFlags, usbFlags;    // pending interrupt flags
+static uint8_t lastPinB, lastPinD, lastPinE;
+static uint8_t buttonMask;
+static uint64_t eepromReady;                    // cycle the current EEPROM write finishes
+static uint8_t adbLineLow;
+
+// board wiring
+#define ADB_BIT         3       // PB3
+static const struct { volatile uint8_t *pinReg; uint8_t bit; } buttonPins[4]=
+{
+    { &PINB, 4 }, { &PINE, 6 }, { &PIND, 4 }, { &PIND, 0 },
+};
+
+#define WEAK_VECTOR(v)  void v(void) __attribute__((weak)); void v(void) { }
+WEAK_VECTOR(INT0_vect)
+WEAK_VECTOR(INT6_vect)
+WEAK_VECTOR(PCINT0_vect)
+WEAK_VECTOR(USB_GEN_vect)
+WEAK_VECTOR(TIMER1_OVF_vect)
+WEAK_VECTOR(TIMER0_COMPA_vect)
+
+static void updatePins(void)
+{
+    PINB= PIND= PINE= 0xFF;
+    for(int i= 0; i<4; ++i)
+        if(buttonMask & (1<<i))
+            *buttonPins[i].pinReg&= ~(1<<buttonPins[i].bit);
+    if(adbLineLow)
+        PINB&= ~(1<<ADB_BIT);
+    if((PINB^lastPinB) & PCMSK0)
+        pcFlags|= 1<<PCIF0;
+    // INT0/INT6 only in 'any edge' mode
+    if(((PIND^lastPinD) & (1<<0)) && (EICRA & 3)==(1<<ISC00))
+        intFlags|= 1<<INTF0;
+    if(((PINE^lastPinE) & (1<<6)) && (EICRB & (3<<ISC60))==(1<<ISC60))
+        intFlags|= 1<<INTF6;
+    lastPinB= PINB;
+    lastPinD= PIND;
+    lastPinE= PINE;
+}
+
+// wired AND: each device sees the host and the others, as they were driving a step ago
+static void adbLineStep(void)
+{
+    static uint8_t devLow[SIM_ADB_MAX];
+    uint8_t hostLow= (DDRB & (1<<ADB_BIT)) && !(PORTB & (1<<ADB_BIT));
+    uint8_t low= hostLow;
+    for(int i= 0; i<simAdbCount; ++i)
+    {
+        uint8_t others= hostLow;
+        for(int j= 0; j<simAdbCount; ++j)
+            others|= j!=i && devLow[j];
+        devLow[i]= adbDevUpdate(&simAdb[i], simMicros(), others);
+        low|= devLow[i];
+    }
+    if(low!=adbLineLow)
+        adbLineLow= low,
+        updatePins();
+}
+
+static void latchDuty(int channel, uint16_t value)
+{
+    if(simDuty[channel]==value)
+        return;
+    simDuty[channel]= value;
+    if(simDutyHook)
+        simDutyHook();
+}
+
+static void timerStep(uint32_t cycles)
+{
+    // fast pwm with TOP=ICRn; OCRn are double buffered and take effect at TOP.
+    // TSM holds the shared prescaler in reset, which halts the timers
+    if(GTCCR & (1<<TSM))
+        return;
+    if(TCCR1B & 7)
+    {
+        uint32_t t1Count= TCNT1 + cycles;
+        while(t1Count>ICR1)
+        {
+            t1Count-= (uint32_t)ICR1+1;
+            flags1|= 1<<TOV1;
+            simTimer1Overflows++;
+            latchDuty(0, OCR1A);
+            latchDuty(1, OCR1B);
+        }
+        TCNT1= t1Count;
+    }
+    if(TCCR3B & 7)
+    {
+        uint32_t t3Count= TCNT3 + cycles;
+        while(t3Count>ICR3)
+        {
+            t3Count-= (uint32_t)ICR3+1;
+            latchDuty(2, OCR3A);
+        }
+        TCNT3= t3Count;
+    }
+}
+
+// apply the firmware's write-one-to-clear accesses
+static void clearFlags(void)
+{
+    flags0&= ~TIFR0;
+    flags1&= ~TIFR1;
+    pcFlags&= ~PCIFR;
+    intFlags&= ~EIFR;
+    TIFR0= TIFR1= PCIFR= EIFR= 0;
+}
+
+static uint32_t interruptsRun;
+
+static uint8_t runVector(uint8_t *flags, uint8_t bit, uint8_t enabled, void (*vector)(void))
+{
+    if(!(*flags & (1<<bit)) || !enabled)
+        return 0;
+    *flags&= ~(1<<bit);
+    interruptsRun++;
+    SREG&= ~(1<<SREG_I);
+    vector();
+    SREG|= 1<<SREG_I;
+    return 1;
+}
+
+// run pending interrupts in vector table order
+static void dispatch(void)
+{
+    clearFlags();
+    while(SREG & (1<<SREG_I))
+    {
+        if(runVector(&intFlags, INTF0, EIMSK & (1<<INT0), INT0_vect)) continue;
+        if(runVector(&intFlags, INTF6, EIMSK & (1<<INT6), INT6_vect)) continue;
+        if(runVector(&pcFlags, PCIF0, PCICR & (1<<PCIE0), PCINT0_vect)) continue;
+        if(runVector(&usbFlags, SOFI, UDIEN & (1<<SOFE), USB_GEN_vect)) continue;
+        if(runVector(&flags1, TOV1, TIMSK1 & (1<<TOIE1), TIMER1_OVF_vect)) continue;
+        if(runVector(&flags0, OCF0A, TIMSK0 & (1<<OCIE0A), TIMER0_COMPA_vect)) continue;
+        break;
+    }
+}
+
+void simAdvance(uint32_t cycles)
+{
+    while(cycles)
+    {
+        // step to the next timer0 tick (clk/64), where the line is sampled
+        uint32_t step= 64 - (simCycles & 63);
+        if(step>cycles)
+            step= cycles;
+        simCycles+= step;
+        cycles-= step;
+        timerStep(step);
+        if(!(simCycles & 63))
+        {
+            clearFlags();
+            if((TCCR0B & 7) && (uint8_t)(simCycles >> 6)==OCR0A)
+                flags0|= 1<<OCF0A;
+            adbLineStep();
+            if(!(simCycles % SIM_USB_FRAME_CYCLES))
+                usbFlags|= 1<<SOFI;
+        }
+        dispatch();
+    }
+}
+
+volatile uint8_t *simTimer0Counter(void)
+{
+    simAdvance(SIM_TCNT_READ_CYCLES);
+    tcnt0= (TCCR0B & 7)? (uint8_t)(simCycles >> 6): 0;
+    return &tcnt0;
+}
+
+void simCli(void)
+{
+    SREG&= ~(1<<SREG_I);
+}
+
+void simSei(void)
+{
+    SREG|= 1<<SREG_I;
+    dispatch();
+}
+
+void simSleep(void)
+{
+    uint32_t n= interruptsRun;
+    while(n==interruptsRun)
+        simAdvance(64 - (simCycles & 63));
+}
+
+void simDelayMs(uint16_t ms)
+{
+    simAdvance((uint32_t)ms * (SIM_F_CPU/1000));
+}
+
+void simSetButtons(uint8_t mask)
+{
+    buttonMask= mask;
+    updatePins();
+}
+
+uint32_t simMicros(void)
+{
+    return simCycles / SIM_CYCLES_PER_US;
+}
+
+// EEPROM: erased to 0xFF, 3.4ms per programmed byte during which it is not ready
+#define SIM_EEPROM_WRITE_CYCLES (SIM_F_CPU/1000*34/10)
+
+int eeprom_is_ready(void)
+{
+    return simCycles>=eepromReady;
+}
+
+uint8_t eeprom_read_byte(const uint8_t *addr)
+{
+    return simEeprom[(uintptr_t)addr & E2END];
+}
+
+uint16_t eeprom_read_word(const uint16_t *addr)
+{
+    return eeprom_read_byte((const uint8_t *)addr) | eeprom_read_byte((const uint8_t *)addr+1)<<8;
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+    for(size_t i= 0; i<n; ++i)
+        ((uint8_t *)dst)[i]= eeprom_read_byte((const uint8_t *)src+i);
+}
+
+void eeprom_write_byte(uint8_t *addr, uint8_t value)
+{
+    // like avr-libc, wait for the previous write to finish
+    if(!eeprom_is_ready())
+        simAdvance(eepromReady-simCycles);
+    simEeprom[(uintptr_t)addr & E2END]= value;
+    simEepromWrites++;
+    eepromReady= simCycles+SIM_EEPROM_WRITE_CYCLES;
+}
+
+void eeprom_update_byte(uint8_t *addr, uint8_t value)
+{
+    if(eeprom_read_byte(addr)!=value)
+        eeprom_write_byte(addr, value);
+}
+
+__attribute__((constructor)) static void simInit(void)
+{
+    memset(simEeprom, 0xFF, sizeof(simEeprom));
+    for(int i= 0; i<SIM_ADB_MAX; ++i)
+        adbDevInit(&simAdb[i], 3);
+    // identical pads tell themselves apart by the random address in register 3
+    for(int i= 0; i<SIM_ADB_MAX; ++i)
+        simAdb[i].random+= i*53;
+    updatePins();
+}
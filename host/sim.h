@@ -0,0 +1,30 @@
+// simulated board for the host build: virtual clock, timers, button pins
+// and TM1001As on the ADB line (PB3).
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include "adbdev.h"
+
+#define SIM_F_CPU           16000000UL
+#define SIM_CYCLES_PER_US   (SIM_F_CPU/1000000)
+#define SIM_USB_FRAME_CYCLES    (SIM_F_CPU/1000)    // a multiple of the 64 cycle step
+
+#define SIM_ADB_MAX         4       // devices on the ADB line
+
+// cycles charged for one read of TCNT0, roughly one iteration of a busy-wait loop
+#define SIM_TCNT_READ_CYCLES    6
+
+extern uint64_t simCycles;                  // virtual clock
+extern struct adbDevice simAdb[SIM_ADB_MAX];   // all touchpads at address 3 after power-on
+extern uint8_t simAdbCount;                 // how many are plugged in, set before setup()
+extern uint16_t simDuty[3];                 // r, g, b duty as latched by the timers at TOP
+extern uint32_t simTimer1Overflows;
+extern void (*simDutyHook)(void);           // called whenever simDuty changes
+
+void simAdvance(uint32_t cycles);
+void simDelayMs(uint16_t ms);
+void simSetButtons(uint8_t mask);           // bit n = button n held down
+uint32_t simMicros(void);
+
+#endif //SIM_H
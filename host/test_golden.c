@@ -0,0 +1,135 @@
+// compares a PWM duty time series written by 'lpsim -o' against a checked-in
+// golden. both are read as step functions: several lines with the same time
+// stamp are one latch, and the values hold until the next one. the test fails
+// if at any moment a channel differs by more than the tolerance.
+//
+// the tolerance comes from -t, otherwise from a '# tolerance <duty>' line in
+// the golden, otherwise 0: a change to hsv2rgb(), hueLerp() or transitionColor()
+// is output-identical, or declares its error bound in the goldens it moves.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_SAMPLES     200000
+#define NCHANNELS       3
+
+struct sample
+{
+    unsigned long t;
+    int duty[NCHANNELS];
+};
+
+static const char *channelName[NCHANNELS]= { "OCR1A", "OCR1B", "OCR3A" };
+
+// returns the number of samples, -1 on error; *tolerance is set if the file declares one
+static int load(const char *name, struct sample *s, int *tolerance)
+{
+    FILE *f= fopen(name, "r");
+    char line[256];
+    int n= 0, lineNo= 0;
+    if(!f)
+    {
+        perror(name);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), f))
+    {
+        struct sample x;
+        lineNo++;
+        if(line[0]=='#')
+        {
+            if(tolerance)
+                sscanf(line, "# tolerance %d", tolerance);
+            continue;
+        }
+        if(sscanf(line, "%lu %d %d %d", &x.t, &x.duty[0], &x.duty[1], &x.duty[2])!=4)
+            continue;
+        if(n && x.t<s[n-1].t)
+        {
+            fprintf(stderr, "%s:%d: time goes backwards\n", name, lineNo);
+            fclose(f);
+            return -1;
+        }
+        // same latch: only the final values count
+        if(n && x.t==s[n-1].t)
+            n--;
+        if(n>=MAX_SAMPLES)
+        {
+            fprintf(stderr, "%s: more than %d samples\n", name, MAX_SAMPLES);
+            fclose(f);
+            return -1;
+        }
+        s[n++]= x;
+    }
+    fclose(f);
+    return n;
+}
+
+int main(int argc, char *argv[])
+{
+    static struct sample golden[MAX_SAMPLES], actual[MAX_SAMPLES];
+    int tolerance= 0, forceTolerance= -1, opt;
+    while((opt= getopt(argc, argv, "t:"))!=-1)
+    {
+        switch(opt)
+        {
+            case 't': forceTolerance= atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-t tolerance] golden actual\n", argv[0]);
+                return 1;
+        }
+    }
+    if(argc-optind!=2)
+    {
+        fprintf(stderr, "usage: %s [-t tolerance] golden actual\n", argv[0]);
+        return 1;
+    }
+    const char *goldenName= argv[optind], *actualName= argv[optind+1];
+    int ng= load(goldenName, golden, &tolerance);
+    int na= load(actualName, actual, NULL);
+    if(ng<0 || na<0)
+        return 1;
+    if(forceTolerance>=0)
+        tolerance= forceTolerance;
+
+    // walk both step functions over the union of their change times, before the
+    // first latch all channels are 0
+    int maxError[NCHANNELS]= { 0 }, bad= 0;
+    unsigned long firstBad= 0;
+    int gi= 0, ai= 0;
+    struct sample g= { 0 }, a= { 0 };
+    while(gi<ng || ai<na)
+    {
+        unsigned long t= gi<ng && (ai>=na || golden[gi].t<=actual[ai].t)? golden[gi].t: actual[ai].t;
+        if(gi<ng && golden[gi].t==t)
+            g= golden[gi++];
+        if(ai<na && actual[ai].t==t)
+            a= actual[ai++];
+        int over= 0;
+        for(int c= 0; c<NCHANNELS; ++c)
+        {
+            int e= abs(g.duty[c]-a.duty[c]);
+            if(e>maxError[c])
+                maxError[c]= e;
+            if(e>tolerance)
+                over= 1;
+        }
+        if(over && !bad++)
+        {
+            firstBad= t;
+            fprintf(stderr, "%s: at %lu us golden %d %d %d, got %d %d %d\n", actualName, t,
+                    g.duty[0], g.duty[1], g.duty[2], a.duty[0], a.duty[1], a.duty[2]);
+        }
+    }
+
+    printf("%-28s %6d latches  max error", goldenName, ng);
+    for(int c= 0; c<NCHANNELS; ++c)
+        printf(" %s %d", channelName[c], maxError[c]);
+    printf("  (tolerance %d)", tolerance);
+    if(bad)
+        printf("  FAIL: %d latches off from %lu us\n", bad, firstBad);
+    else
+        printf("  ok\n");
+    return bad? 1: 0;
+}
@@ -0,0 +1,164 @@
+// equivalence test and benchmark for hsv2rgb(): compares the firmware's
+// division free kernel against the original implementation below.
+//
+// the hue stage is swept exhaustively for every 14-bit h; value and saturation
+// go through identical multiply/shift code in both versions and are swept on a
+// grid (-s 1 covers the complete H*S*V space but takes hours).
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+#define HSV_BITS        14
+#define HSV_MAX         ((1<<HSV_BITS)-1)
+#define RGB_BITS        14
+#define CLAMP(V, min, max) do { if(V<min) V= min; if(V>max) V= max; } while(0);
+
+void hsv2rgb(int h, int s, int v, uint16_t *dest);
+
+// hsv2rgb() as of the baseline. the original indexes interp[7] for the four
+// hues from 6*(HSV_MAX+1)/6 up, which is past the table; the 8th entry here
+// gives those hues the same defined value the new kernel uses.
+static void hsv2rgbReference(int h, int s, int v, uint16_t *dest)
+{
+    struct rgb
+    {
+        int16_t r, g, b;
+    };
+
+    static struct rgb interp[8]=  { { HSV_MAX, 0, 0 },           // red
+                                  { HSV_MAX, 0, HSV_MAX },       // red/blue
+                                  { 0, 0, HSV_MAX },             // blue
+                                  { 0, HSV_MAX, HSV_MAX },       // blue/green
+                                  { 0, HSV_MAX, 0},              // green
+                                  { HSV_MAX, HSV_MAX, 0},        // green/red
+                                  { HSV_MAX, 0, 0 },             // red
+                                  { HSV_MAX, 0, HSV_MAX } };     // red/blue
+    int index;    // table index
+    int offset;   // between entries
+    uint32_t r, g, b;
+    
+    CLAMP(v, 0, HSV_MAX);
+    h&= HSV_MAX;                   // modulo with max value
+    s= (HSV_MAX+1)-s;              // invert saturation
+    index= h / ((HSV_MAX+1)/6);    // calculate table index
+    offset= h % ((HSV_MAX+1)/6);   // and lerp offset
+    
+    // hue
+    r= interp[index].r + (int32_t)(interp[index+1].r-interp[index].r)*offset/(HSV_MAX/6);
+    g= interp[index].g + (int32_t)(interp[index+1].g-interp[index].g)*offset/(HSV_MAX/6);
+    b= interp[index].b + (int32_t)(interp[index+1].b-interp[index].b)*offset/(HSV_MAX/6);
+
+    // value
+    r= (int32_t)(r)*v>>HSV_BITS;
+    g= (int32_t)(g)*v>>HSV_BITS;
+    b= (int32_t)(b)*v>>HSV_BITS;
+
+    // saturation
+    r= r + ((int32_t)(v-r)*s>>HSV_BITS);
+    g= g + ((int32_t)(v-g)*s>>HSV_BITS);
+    b= b + ((int32_t)(v-b)*s>>HSV_BITS);
+
+    dest[0]= r>>(HSV_BITS-RGB_BITS); dest[1]= g>>(HSV_BITS-RGB_BITS); dest[2]= b>>(HSV_BITS-RGB_BITS);
+}
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static uint64_t cycles(void)
+{
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+typedef void (*kernel_t)(int h, int s, int v, uint16_t *dest);
+
+static void bench(const char *label, kernel_t kernel, uint32_t n)
+{
+    volatile uint16_t sink= 0;
+    uint16_t rgb[3];
+    double t0= nowSeconds();
+    uint64_t c0= cycles();
+    for(uint32_t i= 0; i<n; ++i)
+    {
+        kernel((i*7919) & HSV_MAX, (i*104729>>3) & HSV_MAX, (i*1299709>>5) & HSV_MAX, rgb);
+        sink+= rgb[0]^rgb[1]^rgb[2];
+    }
+    uint64_t c1= cycles();
+    double dt= nowSeconds()-t0;
+    printf("%-10s %8.2f ns/call", label, dt*1e9/n);
+#ifdef HAVE_TSC
+    printf(" %8.1f tsc cycles/call", (double)(c1-c0)/n);
+#endif
+    printf("\n");
+    (void)sink;
+}
+
+int main(int argc, char *argv[])
+{
+    int step= 255;
+    uint32_t benchCalls= 20000000;
+    int opt;
+    while((opt= getopt(argc, argv, "s:b:"))!=-1)
+    {
+        switch(opt)
+        {
+            case 's': step= atoi(optarg); break;
+            case 'b': benchCalls= strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-s sv-step] [-b bench-calls]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(step<1)
+        step= 1;
+
+    uint64_t calls= 0, mismatches= 0;
+    int maxError= 0, worst[3]= { 0 };
+    for(int s= 0; s<=HSV_MAX; s= (s==HSV_MAX || s+step<=HSV_MAX)? s+step: HSV_MAX)
+    {
+        for(int v= 0; v<=HSV_MAX; v= (v==HSV_MAX || v+step<=HSV_MAX)? v+step: HSV_MAX)
+        {
+            for(int h= 0; h<=HSV_MAX; ++h)
+            {
+                uint16_t a[3], b[3];
+                hsv2rgb(h, s, v, a);
+                hsv2rgbReference(h, s, v, b);
+                calls++;
+                for(int c= 0; c<3; ++c)
+                {
+                    int err= abs((int)a[c]-(int)b[c]);
+                    if(err)
+                        mismatches++;
+                    if(err>maxError)
+                        maxError= err, worst[0]= h, worst[1]= s, worst[2]= v;
+                }
+            }
+        }
+    }
+    printf("compared %llu hsv triples (s/v step %d): max error %d lsb, %llu channel mismatches",
+           (unsigned long long)calls, step, maxError, (unsigned long long)mismatches);
+    if(maxError)
+        printf(", worst at h=%d s=%d v=%d", worst[0], worst[1], worst[2]);
+    printf("\n");
+
+    if(benchCalls)
+    {
+        bench("reference", hsv2rgbReference, benchCalls);
+        bench("hsv2rgb", hsv2rgb, benchCalls);
+    }
+
+    return maxError? 1: 0;
+}
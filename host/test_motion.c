@@ -0,0 +1,160 @@
+// replays touchpad traces through the firmware's motion filter and measures
+// jitter at rest against lag while moving, for the raw samples and the filter.
+//
+// there is no ground truth in a recording, so the reference is a centered
+// (non-causal) moving average of the raw samples. rest is where the reference
+// moves slower than REST_SPEED; jitter is the RMS sample to sample change there.
+// lag is the delay that best matches the output to the reference while moving.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include "motion.h"
+
+extern struct motionParams motionParams;    // firmware defaults
+
+#define MAX_SAMPLES     100000
+#define REF_WINDOW      25                  // ms each side of the moving average
+#define REST_SPEED      50                  // units/s
+#define MAX_LAG         100                 // ms
+
+// limits the test enforces for the filter
+#define MIN_JITTER_GAIN 3.0                 // jitter at rest at least this much lower than raw
+#define MAX_FILTER_LAG  20                  // ms
+
+struct sample
+{
+    int t, x, y;
+};
+
+static struct sample raw[MAX_SAMPLES], ref[MAX_SAMPLES];
+static double out[MAX_SAMPLES][2];
+static int64_t moved[2], movedRaw[2];       // accelerated and raw travel, absolute
+static int n;
+
+static int loadTrace(const char *name)
+{
+    FILE *f= fopen(name, "r");
+    char line[128];
+    if(!f)
+        return perror(name), -1;
+    n= 0;
+    while(fgets(line, sizeof(line), f) && n<MAX_SAMPLES)
+        if(line[0]!='#' && sscanf(line, "%d %d %d", &raw[n].t, &raw[n].x, &raw[n].y)==3)
+            n++;
+    fclose(f);
+    return n;
+}
+
+static void reference(void)
+{
+    for(int i= 0, lo= 0, hi= 0; i<n; ++i)
+    {
+        double sx= 0, sy= 0;
+        while(raw[lo].t<raw[i].t-REF_WINDOW) lo++;
+        while(hi<n-1 && raw[hi+1].t<=raw[i].t+REF_WINDOW) hi++;
+        for(int k= lo; k<=hi; ++k)
+            sx+= raw[k].x, sy+= raw[k].y;
+        ref[i].t= raw[i].t;
+        ref[i].x= lrint(sx/(hi-lo+1));
+        ref[i].y= lrint(sy/(hi-lo+1));
+    }
+}
+
+// reference position 'lag' ms before sample i, linearly interpolated
+static double refAt(int i, int axis, int lag)
+{
+    int t= raw[i].t-lag;
+    while(i>0 && ref[i].t>t) i--;
+    if(i==n-1 || ref[i].t>=t)
+        return axis? ref[i].y: ref[i].x;
+    double u= (double)(t-ref[i].t)/(ref[i+1].t-ref[i].t);
+    return axis? ref[i].y+u*(ref[i+1].y-ref[i].y): ref[i].x+u*(ref[i+1].x-ref[i].x);
+}
+
+static int resting(int i)
+{
+    if(i==0)
+        return 1;
+    double dt= (ref[i].t-ref[i-1].t)*1e-3;
+    return fabs(ref[i].x-ref[i-1].x)/dt<REST_SPEED && fabs(ref[i].y-ref[i-1].y)/dt<REST_SPEED;
+}
+
+static void measure(const char *label, double *jitter, int *lag)
+{
+    double sum= 0;
+    int count= 0;
+    for(int i= 1; i<n; ++i)
+        if(resting(i) && resting(i-1))
+            for(int a= 0; a<2; ++a)
+                sum+= (out[i][a]-out[i-1][a])*(out[i][a]-out[i-1][a]), count++;
+    *jitter= count? sqrt(sum/count): 0;
+
+    double best= -1;
+    for(int l= 0; l<=MAX_LAG; ++l)
+    {
+        double err= 0;
+        for(int i= 0; i<n; ++i)
+            if(!resting(i))
+                for(int a= 0; a<2; ++a)
+                    err+= (out[i][a]-refAt(i, a, l))*(out[i][a]-refAt(i, a, l));
+        if(best<0 || err<best)
+            best= err, *lag= l;
+    }
+    printf("  %-8s jitter %6.2f units rms   lag %3d ms\n", label, *jitter, *lag);
+}
+
+static int runTrace(const char *name)
+{
+    struct motionFilter filter;
+    double rawJitter, filterJitter;
+    int rawLag, filterLag;
+
+    if(loadTrace(name)<2)
+        return fprintf(stderr, "%s: no samples\n", name), 1;
+    reference();
+
+    printf("%s: %d samples, %d ms\n", name, n, raw[n-1].t-raw[0].t);
+    for(int i= 0; i<n; ++i)
+        out[i][0]= raw[i].x, out[i][1]= raw[i].y;
+    measure("raw", &rawJitter, &rawLag);
+
+    motionReset(&filter);
+    memset(moved, 0, sizeof(moved));
+    memset(movedRaw, 0, sizeof(movedRaw));
+    for(int i= 0; i<n; ++i)
+    {
+        int16_t rel[2];
+        motionUpdate(&filter, &motionParams, raw[i].x, raw[i].y, raw[i].t, rel);
+        out[i][0]= motionPosition(&filter, 0);
+        out[i][1]= motionPosition(&filter, 1);
+        if(i)
+            for(int a= 0; a<2; ++a)
+                moved[a]+= abs(rel[a]),
+                movedRaw[a]+= abs((a? raw[i].y-raw[i-1].y: raw[i].x-raw[i-1].x));
+    }
+    measure("filter", &filterJitter, &filterLag);
+    printf("  travel   raw %lld/%lld  accelerated %lld/%lld units (x/y)\n", 
+           (long long)movedRaw[0], (long long)movedRaw[1], (long long)moved[0], (long long)moved[1]);
+
+    if(filterJitter*MIN_JITTER_GAIN>rawJitter || filterLag>MAX_FILTER_LAG)
+    {
+        printf("  FAIL: want jitter below %.2f and lag up to %d ms\n", rawJitter/MIN_JITTER_GAIN, MAX_FILTER_LAG);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int fails= 0;
+    if(argc<2)
+    {
+        fprintf(stderr, "usage: %s trace...\n", argv[0]);
+        return 1;
+    }
+    for(int i= 1; i<argc; ++i)
+        fails+= runTrace(argv[i]);
+    return fails? 1: 0;
+}
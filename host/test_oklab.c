@@ -0,0 +1,124 @@
+// accuracy test for the fixed-point OKLab in oklab.c against a double
+// reference, and the property the transitions use it for: between any two
+// full colors, or a color and white, the lightness of what comes out changes
+// evenly. the same walk through HSV is measured for comparison.
+//
+// the RGB values are the ones before the curves, linearized with CIE L*.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "oklab.h"
+
+#define RGB_MAX         OKLAB_RGB_MAX
+#define LAB_TOLERANCE   0.003       // per component, L is 0..1
+#define RGB_TOLERANCE   200         // round trip, RGB units
+#define LERP_TOLERANCE  0.005       // lightness off the straight line
+
+void hsv2rgb(int h, int s, int v, uint16_t *dest);
+uint16_t hueLerp(int32_t a, int32_t b, uint16_t offset);
+
+static double linearize(double x)
+{
+    return x>0.08? pow((x*100+16)/116, 3): x*100/903.3;
+}
+
+static void reference(const uint16_t *rgb, double *lab)
+{
+    double r= linearize(rgb[0]/(RGB_MAX+1.0)), g= linearize(rgb[1]/(RGB_MAX+1.0)), b= linearize(rgb[2]/(RGB_MAX+1.0));
+    double l= cbrt(0.4122214708*r + 0.5363325363*g + 0.0514459929*b);
+    double m= cbrt(0.2119034982*r + 0.6806995451*g + 0.1073969566*b);
+    double s= cbrt(0.0883024619*r + 0.2817188376*g + 0.6299787005*b);
+    lab[0]= 0.2104542553*l + 0.7936177850*m - 0.0040720468*s;
+    lab[1]= 1.9779984951*l - 2.4285922050*m + 0.4505937099*s;
+    lab[2]= 0.0259040371*l + 0.7827717662*m - 0.8086757660*s;
+}
+
+// largest distance of the output's lightness from the straight line between the ends
+static double lightnessError(const uint16_t *from, const uint16_t *to, const uint16_t (*walk)[3], int steps)
+{
+    double a[3], b[3], x[3], maxError= 0;
+    reference(from, a);
+    reference(to, b);
+    for(int i= 0; i<=steps; ++i)
+    {
+        reference(walk[i], x);
+        double e= fabs(x[0] - (a[0] + (b[0]-a[0])*i/steps));
+        if(e>maxError)
+            maxError= e;
+    }
+    return maxError;
+}
+
+int main(void)
+{
+    int fail= 0;
+
+    // conversions on a grid over the RGB cube
+    double labError= 0;
+    int rgbError= 0;
+    for(int r= 0; r<=RGB_MAX; r+= 257)
+        for(int g= 0; g<=RGB_MAX; g+= 257)
+            for(int b= 0; b<=RGB_MAX; b+= 257)
+            {
+                uint16_t rgb[3]= { r, g, b }, back[3];
+                int16_t lab[3];
+                double ref[3];
+                oklabFromRgb(rgb, lab);
+                reference(rgb, ref);
+                for(int c= 0; c<3; ++c)
+                    if(fabs(lab[c]/(double)OKLAB_ONE - ref[c])>labError)
+                        labError= fabs(lab[c]/(double)OKLAB_ONE - ref[c]);
+                oklabToRgb(lab, back);
+                for(int c= 0; c<3; ++c)
+                    if(abs(back[c]-rgb[c])>rgbError)
+                        rgbError= abs(back[c]-rgb[c]);
+            }
+    printf("oklabFromRgb   max error %.5f (tolerance %.5f)\n", labError, LAB_TOLERANCE);
+    printf("oklabToRgb     max round trip error %d (tolerance %d)\n", rgbError, RGB_TOLERANCE);
+    fail|= labError>LAB_TOLERANCE || rgbError>RGB_TOLERANCE;
+
+    // transitions between the six full hues and white, as presets with s and v at full scale
+    enum { STEPS= 64, NCOLORS= 7 };
+    int hsv[NCOLORS][3];
+    for(int i= 0; i<6; ++i)
+        hsv[i][0]= i*(RGB_MAX+1)/6, hsv[i][1]= RGB_MAX, hsv[i][2]= RGB_MAX;
+    hsv[6][0]= 0, hsv[6][1]= 0, hsv[6][2]= RGB_MAX;
+    double worst[3]= { 0, 0, 0 };
+    for(int i= 0; i<NCOLORS; ++i)
+        for(int k= 0; k<NCOLORS; ++k)
+        {
+            uint16_t from[3], to[3], walk[3][STEPS+1][3];
+            int16_t a[3], b[3], lab[3];
+            if(i==k)
+                continue;
+            hsv2rgb(hsv[i][0], hsv[i][1], hsv[i][2], from);
+            hsv2rgb(hsv[k][0], hsv[k][1], hsv[k][2], to);
+            oklabFromRgb(from, a);
+            oklabFromRgb(to, b);
+            for(int t= 0; t<=STEPS; ++t)
+            {
+                uint16_t offset= t*(1<<OKLAB_LERP_BITS)/STEPS;
+                hsv2rgb(hueLerp(hsv[i][0], hsv[k][0], offset), hsv[i][1] + (hsv[k][1]-hsv[i][1])*t/STEPS,
+                        hsv[i][2] + (hsv[k][2]-hsv[i][2])*t/STEPS, walk[0][t]);
+                for(int polar= 0; polar<2; ++polar)
+                {
+                    oklabLerp(a, b, offset, polar, lab);
+                    oklabToRgb(lab, walk[1+polar][t]);
+                }
+            }
+            for(int space= 0; space<3; ++space)
+            {
+                double e= lightnessError(from, to, (const uint16_t (*)[3])walk[space], STEPS);
+                if(e>worst[space])
+                    worst[space]= e;
+            }
+        }
+    printf("lightness off the line, max: HSV %.4f, OKLab %.4f, OKLCh %.4f (tolerance %.4f)\n",
+           worst[0], worst[1], worst[2], LERP_TOLERANCE);
+    fail|= worst[1]>LERP_TOLERANCE || worst[2]>LERP_TOLERANCE;
+
+    if(fail)
+        printf("FAIL\n");
+    return fail;
+}
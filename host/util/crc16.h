@@ -0,0 +1,34 @@
+#ifndef HOST_UTIL_CRC16_H
+#define HOST_UTIL_CRC16_H
+
+#include <stdint.h>
+
+// same as the avr-libc inline asm version
+static inline uint8_t _crc8_ccitt_update(uint8_t inCrc, uint8_t inData)
+{
+    uint8_t data= inCrc ^ inData;
+    for(uint8_t i= 0; i<8; i++)
+    {
+        if(data & 0x80)
+            data= (data << 1) ^ 0x07;
+        else
+            data<<= 1;
+    }
+    return data;
+}
+
+// polynomial 0xA001 (reflected 0x8005), as in avr-libc
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t a)
+{
+    crc^= a;
+    for(uint8_t i= 0; i<8; i++)
+    {
+        if(crc & 1)
+            crc= (crc >> 1) ^ 0xA001;
+        else
+            crc>>= 1;
+    }
+    return crc;
+}
+
+#endif //HOST_UTIL_CRC16_H
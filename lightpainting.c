@@ -1,6 +1,16 @@
 #include <math.h>
 #include <stdlib.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
 #include "main.h"
+#include "stats.h"
+#include "sched.h"
+#include "serial.h"
+#include "motion.h"
+#include "trace.h"
+#include "calibration.h"
+#include "oklab.h"
+#include "vendor.h"
 
 // rgb led resistor values....
 // G: 2.2 + 1.0 parallel
@@ -13,7 +23,15 @@
 #define ADB_PDIR    DDRB    // data direction register
 #define ADB_TCNT    TCNT0   // timer counter register
 #define TIMER_DIV   64      // timer clock divisor
+#define ADB_PCMSK   PCMSK0  // pin change mask register
+#define ADB_PCINT   PCINT3  // pin change interrupt bit of ADB_PIN
+#define ADB_ISR_ENTER()     STATS_BEGIN(STATS_ADB)
+#define ADB_ISR_EXIT()      STATS_END(STATS_ADB)
+// PB4 is a button, scanned only when it changed and not on every ADB edge
+#define ADB_PCINT_OTHER(changed)    do { if((changed) & (1<<PB4)) buttonScan(); } while(0)
+void buttonScan(void);
 #include "tm1001a.h"
+#include "adbbus.h"
 
 #define CLAMP(V, min, max) do { if(V<min) V= min; if(V>max) V= max; } while(0);
 
@@ -22,6 +40,20 @@
 #define TOUCHPAD_YMIN   500
 #define TOUCHPAD_YMAX   4500
 
+// touchpad filter and acceleration, see motion.h. scheduler ticks stand in for ms.
+// at rest the cutoff is 1 Hz and slow strokes move at half speed for fine
+// adjustment; fast strokes get up to 6x so one sweep covers the whole range.
+struct motionParams motionParams=
+{
+    .minCutoff= 1*256,
+    .beta= 260,                 // ~20 Hz at 5000 units/s
+    .dCutoff= 1*256,
+    .accelLowSpeed= 300,
+    .accelHighSpeed= 5000,
+    .accelLowGain= 8,
+    .accelHighGain= 96,
+};
+
 #define RGB_BITS        14
 #define RGB_MAX         ((1<<RGB_BITS)-1)
 #define HSV_BITS        14
@@ -46,6 +78,13 @@
 
 void setLEDs(int16_t r, int16_t g, int16_t b);
 void setLEDsHSV(uint16_t h, uint16_t s, uint16_t v);
+void ledFrameMake(struct ledFrame *frame, int16_t r, int16_t g, int16_t b);
+void ledFrameShow(const volatile struct ledFrame *frame);
+void hsv2rgb(int h, int s, int v, uint16_t *dest);
+void buttonTask(void);
+void vendorTask(void);
+void touchpadTask(void);
+void touchpadWake(void);
 
 
 struct buttondesc
@@ -54,14 +93,16 @@ struct buttondesc
     volatile uint8_t *portReg;
     volatile uint8_t *pinReg;
     uint8_t pin;
+    volatile uint8_t *maskReg;  // interrupt mask register, 0 if the pin has no interrupt
+    uint8_t maskBit;
 };
 
 static const struct buttondesc buttons[NBUTTONS]=
 {
-    { &DDRB, &PORTB, &PINB, 4 },
-    { &DDRE, &PORTE, &PINE, 6 },
-    { &DDRD, &PORTD, &PIND, 4 },
-    { &DDRD, &PORTD, &PIND, 0 },
+    { &DDRB, &PORTB, &PINB, 4, &PCMSK0, PCINT4 },
+    { &DDRE, &PORTE, &PINE, 6, &EIMSK, INT6 },
+    { &DDRD, &PORTD, &PIND, 4, 0, 0 },
+    { &DDRD, &PORTD, &PIND, 0, &EIMSK, INT0 },
 };
 
 struct hsv
@@ -91,6 +132,68 @@ volatile struct transitionSetting transitionSettings[NPRESETS*NPRESETS]=
     { TRANSITION_MAX/25 }, { TRANSITION_MAX/25 }, { TRANSITION_MAX/25 }, { TRANSITION_MAX/25 }, 
 };
 
+// presets and transition speeds are saved to the EEPROM once they haven't changed
+// for PERSIST_IDLE_MS, so dragging on the touchpad doesn't wear it out
+#define PERSIST_BASE        0
+#define PERSIST_SLOT_SIZE   128
+#define PERSIST_SLOTS       8
+#define PERSIST_VERSION     2           // 1 had no calibration, in 64 byte slots
+#define PERSIST_IDLE_MS     3000
+#include "persist.h"
+
+struct settingsRecord
+{
+    uint16_t presets[NPRESETS][3];                  // h, s, v
+    uint16_t velocities[NPRESETS*NPRESETS];
+    struct calibration calibration;
+};
+CASSERT(sizeof(struct settingsRecord)<=PERSIST_PAYLOAD, settingsRecordSize);
+
+volatile uint16_t settingsCountdown;    // PWM periods until the settings are committed
+volatile bool settingsDue;
+
+// settings were changed, (re)start the idle countdown. call with interrupts disabled
+// or under pwmLock(): pwmPeriod() is the only other user of settingsCountdown
+void settingsChanged(void)
+{
+    settingsCountdown= (uint32_t)PERSIST_IDLE_MS*(F_CPU/1000)/(RGB_MAX+1);
+}
+
+void settingsLoad(void)
+{
+    struct settingsRecord rec;
+    if(!persistLoad(&rec, sizeof(rec)))
+        return;
+    for(uint8_t i= 0; i<NPRESETS; ++i)
+        presets[i].h= rec.presets[i][0] & HSV_MAX,
+        presets[i].s= min(rec.presets[i][1], HSV_MAX),
+        presets[i].v= min(rec.presets[i][2], HSV_MAX);
+    for(uint8_t i= 0; i<NPRESETS*NPRESETS; ++i)
+        transitionSettings[i].velocity= min(rec.velocities[i], TRANSITION_MAX);
+    calibration= rec.calibration;
+    calibrationLimit(&calibration);
+    calibrationApply();
+}
+
+// main loop part: snapshot the settings when due, then trickle the record out
+void settingsTask(void)
+{
+    if(settingsDue && !persistBusy())
+    {
+        struct settingsRecord rec;
+        settingsDue= false;
+        for(uint8_t i= 0; i<NPRESETS; ++i)
+            rec.presets[i][0]= presets[i].h,
+            rec.presets[i][1]= presets[i].s,
+            rec.presets[i][2]= presets[i].v;
+        for(uint8_t i= 0; i<NPRESETS*NPRESETS; ++i)
+            rec.velocities[i]= transitionSettings[i].velocity;
+        rec.calibration= calibration;
+        persistBeginWrite(&rec, sizeof(rec));
+    }
+    persistWriteStep();
+}
+
 // get index into transitionSettings for 2 presets
 uint8_t transitionIndex(uint8_t presetA, uint8_t presetB)
 {
@@ -98,35 +201,71 @@ uint8_t transitionIndex(uint8_t presetA, uint8_t presetB)
     return min(a,b)*NPRESETS + max(a,b);
 }
 
-// currently active transitions
-volatile struct
+// currently active transitions. only the main loop touches these, it computes
+// the colors ahead into transitionQueue and the overflow ISR just shows them.
+enum transitionMode
+{
+    TRANSITION_ROTATE,      // walk from preset to preset in the order they were pressed
+    TRANSITION_MIX,         // weighted blend of all held presets, the weights follow the walk
+    NTRANSITIONMODES
+};
+
+// where the transitions interpolate
+enum transitionSpace
+{
+    SPACE_HSV,              // hue, saturation and value on their own; cheap, but dark muddy mixes
+    SPACE_OKLAB,            // straight line in OKLab, the lightness changes evenly
+    SPACE_OKLCH,            // OKLab in polar form, the hue turns with the chroma kept up
+    NTRANSITIONSPACES
+};
+CASSERT(OKLAB_RGB_MAX==RGB_MAX && OKLAB_LERP_BITS==TRANSITION_BITS, oklabScale);
+
+struct
 {
     uint8_t presetIndices[NPRESETS];    // presets to lerp
     uint8_t count;                      // number of presets
     uint8_t index;                      // current index into presetIndices
     uint16_t offset;                    // offset between two presets
-} activeTransitions;
+    uint8_t mode;
+    uint8_t easing;
+    uint8_t space;
+} activeTransitions= { .mode= TRANSITION_ROTATE, .space= SPACE_HSV };
 
-void transitionReset(void)
+#define TRANSITION_PERIODS  10          // PWM periods per transition step, ~100 per second
+#define TRANSITION_QUEUE    4           // steps computed ahead, power of 2
+volatile struct
+{
+    struct ledFrame frames[TRANSITION_QUEUE];
+    uint8_t head;                       // written by the main loop
+    uint8_t tail;                       // written by the ISR
+    uint16_t underruns;
+} transitionQueue;
+
+// drop the steps computed ahead, e.g. when the held presets change
+void transitionFlush(void)
 {
     cli();
-    activeTransitions.count= activeTransitions.index= activeTransitions.offset= 0;
+    transitionQueue.head= transitionQueue.tail;
     sei();
 }
 
+void transitionReset(void)
+{
+    activeTransitions.count= activeTransitions.index= activeTransitions.offset= 0;
+    transitionFlush();
+}
+
 void transitionAdd(uint8_t preset)
 {
-    cli();
     activeTransitions.count%= NPRESETS;
     activeTransitions.presetIndices[activeTransitions.count]= preset;
     activeTransitions.count++;
     activeTransitions.offset= 0;
-    sei();
+    transitionFlush();
 }
 
 void transitionRemove(uint8_t preset)
 {
-    cli();
     for(int i= 0; i<activeTransitions.count; ++i)
     {
         if(activeTransitions.presetIndices[i]==preset)
@@ -139,48 +278,152 @@ void transitionRemove(uint8_t preset)
     }
     activeTransitions.offset= 0;
     activeTransitions.index= 0;
-    sei();
+    transitionFlush();
 }
 
-void buttonSetup(void)
+uint8_t buttonRead(void)
 {
+    uint8_t ret= 0;
     for(int i= 0; i<sizeof(buttons)/sizeof(buttons[0]); ++i)
     {
-        *buttons[i].ddrReg &= ~(1<<buttons[i].pin);
-        *buttons[i].portReg |= 1<<buttons[i].pin;
+        uint8_t val= (*buttons[i].pinReg & (1<<buttons[i].pin)) >> buttons[i].pin;
+        ret|= (val^1) << i;
     }
+    return ret;
 }
 
-uint8_t buttonRead(void)
+// button edges: PB4 (pin change, shared with ADB), PE6 (INT6) and PD0 (INT0) interrupt
+// on both edges; PD4 has no interrupt and is sampled every PWM_PERIOD_US by the Timer1 ISR.
+// the first edge is taken right away and masks the pin's interrupt for BUTTON_DEBOUNCE
+// ticks so the bouncing doesn't cost anything. afterwards the pin is sampled again, which
+// also catches a release that happened during the lockout.
+#define BUTTON_DEBOUNCE     SCHED_MS(10)
+#define BUTTON_EVENTS       8               // power of 2
+
+struct buttonEvent
+{
+    uint8_t buttons;                        // debounced state after the edge
+    uint16_t time;                          // schedNow when it happened
+};
+
+volatile struct
+{
+    struct buttonEvent events[BUTTON_EVENTS];
+    uint8_t head;                           // written by the ISRs
+    uint8_t tail;                           // written by the main loop
+    uint8_t state;                          // debounced state
+    uint8_t lockout[NBUTTONS];              // ticks until the pin is looked at again
+    uint8_t dropped;
+} buttonEvents;
+
+// compare the pins with the debounced state and queue an event for changes.
+// called from interrupts, or with them disabled
+void buttonScan(void)
+{
+    uint8_t changed= buttonRead() ^ buttonEvents.state;
+    uint8_t accepted= 0;
+    for(uint8_t i= 0; i<NBUTTONS; ++i)
+    {
+        if(!(changed & (1<<i)) || buttonEvents.lockout[i])
+            continue;
+        accepted|= 1<<i;
+        buttonEvents.lockout[i]= BUTTON_DEBOUNCE;
+        if(buttons[i].maskReg)
+            *buttons[i].maskReg&= ~(1<<buttons[i].maskBit);
+    }
+    if(!accepted)
+        return;
+    buttonEvents.state^= accepted;
+    uint8_t head= buttonEvents.head;
+    if((uint8_t)(head-buttonEvents.tail)>=BUTTON_EVENTS)
+    {
+        buttonEvents.dropped++;
+        return;
+    }
+    buttonEvents.events[head%BUTTON_EVENTS].buttons= buttonEvents.state;
+    buttonEvents.events[head%BUTTON_EVENTS].time= schedTime();
+    buttonEvents.head= head+1;
+}
+
+// from the Timer1 ISR every PWM_PERIOD_US: count down the lockouts, sample PD4
+static void buttonTick(void)
+{
+    cli();
+    for(uint8_t i= 0; i<NBUTTONS; ++i)
+        if(buttonEvents.lockout[i] && !--buttonEvents.lockout[i] && buttons[i].maskReg)
+            *buttons[i].maskReg|= 1<<buttons[i].maskBit;
+    buttonScan();
+    sei();
+}
+
+ISR(INT0_vect)
+{
+    buttonScan();
+}
+
+ISR(INT6_vect)
+{
+    buttonScan();
+}
+
+void buttonSetup(void)
 {
-    uint8_t ret= 0;
     for(int i= 0; i<sizeof(buttons)/sizeof(buttons[0]); ++i)
     {
-        uint8_t val= (*buttons[i].pinReg & (1<<buttons[i].pin)) >> buttons[i].pin;
-        ret|= (val^1) << i;
+        *buttons[i].ddrReg &= ~(1<<buttons[i].pin);
+        *buttons[i].portReg |= 1<<buttons[i].pin;
+        if(buttons[i].maskReg)
+            *buttons[i].maskReg|= 1<<buttons[i].maskBit;
     }
-    return ret;
+    EICRA= (1<<ISC00);                      // INT0 on any edge
+    EICRB= (1<<ISC60);                      // INT6 on any edge
+    EIFR= (1<<INTF0) | (1<<INTF6);
+    PCICR|= (1<<PCIE0);
 }
 
+// the touchpad is polled every millisecond while it's in use and backs off when
+// nobody touched it or a button for a while, so the CPU sleeps between polls.
+// backed off, a poll is started every TOUCHPAD_IDLE_PERIOD_x and its answer picked
+// up a few ms later, so the first touch after a pause is seen within one period.
+#define TOUCHPAD_IDLE_AFTER_1       SCHED_MS(5000)
+#define TOUCHPAD_IDLE_PERIOD_1      SCHED_MS(50)
+#define TOUCHPAD_IDLE_AFTER_2       SCHED_MS(60000)
+#define TOUCHPAD_IDLE_PERIOD_2      SCHED_MS(250)
+
+static int8_t touchpadTaskId;
+static uint16_t touchpadActive;             // schedTime() of the last touch or button event
+static uint8_t touchpadIdle;                // backoff level 0..2
+
 void touchpadTimerSetup(void)
 {
     TCCR0A= 0;
     TCCR0B= (1<<CS01) | (1<<CS00);  // set timer0 clock divisor to 64
 }
 
+// find the devices on the bus and switch every one that came up at the mouse
+// address and takes the TM1001A's handler into absolute mode
 void touchpadInitADB(void)
 {
 	uint8_t adbData[8];
     
-    // switch to absolute mode
-    adbData[0] = 0b01100011;    // enabled, device addr 3
-    adbData[1] = 4; //CDM mode
-    adbExecuteCommand(COM_LISTEN3, adbData, 2);
+    adbBusEnumerate();
+    for(uint8_t i= 0; i<adbBus.count; ++i)
+    {
+        struct adbBusDevice *d= &adbBus.devices[i];
+        uint8_t handler;
+        if(d->defaultAddress!=3)
+            continue;
+        adbListenRegister3(d->address, d->address, 4);     // CDM mode
+        if(!adbTalkRegister3(d->address, &handler) || handler!=4)
+            continue;
+        d->handler= handler;
+        d->kind= ADB_KIND_PAD;
 
-    adbExecuteCommand(COM_TALK1, adbData, 0); // get original values
+        adbExecuteCommand(ADB_cmdByte(ADBCMD_TALK, d->address, 1), adbData, 0);    // get original values
 
-    adbData[6] = 0x00; //set absolute mode
-    adbExecuteCommand(COM_LISTEN1, adbData, 7);
+        adbData[6] = 0x00; //set absolute mode
+        adbExecuteCommand(ADB_cmdByte(ADBCMD_LISTEN, d->address, 1), adbData, 7);
+    }
 }
 
 void statusLED(bool on)
@@ -191,6 +434,22 @@ void statusLED(bool on)
         PORTB|= 1<<0;
 }
 
+// flash the status LED for about 100 ms without blocking the main loop
+#define STATUS_TASK_MS      20
+static uint8_t statusCountdown;
+
+void statusBlink(void)
+{
+    statusLED(true);
+    statusCountdown= 100/STATUS_TASK_MS;
+}
+
+void statusTask(void)
+{
+    if(statusCountdown && !--statusCountdown)
+        statusLED(false);
+}
+
 #define ILERP(a, b, offset, bits) ( (a) + ( ((b)-(a)) * (offset) >> (bits) ) )
 
 uint16_t hueLerp(int32_t a, int32_t b, uint16_t offset)
@@ -205,37 +464,508 @@ uint16_t hueLerp(int32_t a, int32_t b, uint16_t offset)
     return ILERP(a, b, offset, TRANSITION_BITS);
 }
 
-// called every 10 timer ticks (~100x per sec)
-void lerpTransitions(void)
+// easing curves, map 0..0xFFFF to 0..0xFFFF
+enum easing
+{
+    EASE_LINEAR,
+    EASE_IN,            // quadratic
+    EASE_OUT,
+    EASE_IN_OUT,        // smoothstep
+    EASE_CUBIC,         // cubic in/out
+    EASE_HOLD,          // keep the start value until the end
+    NEASINGS
+};
+
+uint16_t ease(uint8_t type, uint16_t u)
 {
-    if(activeTransitions.count<2)
+    uint16_t v;
+    switch(type)
+    {
+        case EASE_IN:
+            return (uint32_t)u*(u+1UL) >> 16;
+        case EASE_OUT:
+            v= ~u;
+            return ~(uint16_t)((uint32_t)v*(v+1UL) >> 16);
+        case EASE_IN_OUT:
+            // 3u^2-2u^3 in 1.15 fixed point
+            v= u>>1;
+            v= (uint32_t)v*v >> 15;
+            return min(((uint32_t)v*(3*32768UL - (u&0xFFFE)) >> 15) << 1, 0xFFFF);
+        case EASE_CUBIC:
+            // 4u^3 below the middle, mirrored above
+            v= u<0x8000? u<<1: (uint16_t)~u<<1;
+            v= (uint32_t)((uint32_t)v*v >> 16)*v >> 17;
+            return u<0x8000? v: ~v;
+        case EASE_HOLD:
+            return 0;
+        default:
+            return u;
+    }
+}
+
+// OKLab of the presets, converted again only when one is edited. all zero
+// matches the zeroed hsv, black
+static struct
+{
+    struct hsv hsv;
+    int16_t lab[3];
+} presetLabs[NPRESETS];
+
+static const int16_t *presetLab(uint8_t preset)
+{
+    const struct hsv *p= &presets[preset];
+    struct hsv *cached= &presetLabs[preset].hsv;
+    if(cached->h!=p->h || cached->s!=p->s || cached->v!=p->v)
+    {
+        uint16_t rgb[3];
+        hsv2rgb(p->h, p->s, p->v, rgb);
+        oklabFromRgb(rgb, presetLabs[preset].lab);
+        *cached= *p;
+    }
+    return presetLabs[preset].lab;
+}
+
+// color of the current transition step
+void transitionColor(struct ledFrame *frame)
+{
+    uint8_t count= activeTransitions.count;
+    uint8_t presetA= activeTransitions.presetIndices[activeTransitions.index], 
+            presetB= activeTransitions.presetIndices[(activeTransitions.index+1)%count];
+    uint16_t u= ease(activeTransitions.easing, activeTransitions.offset<<1);
+    
+    if(activeTransitions.mode==TRANSITION_ROTATE)
+    {
+        uint16_t rgb[3];
+        uint16_t offset= u>>(16-TRANSITION_BITS);
+        if(activeTransitions.space==SPACE_HSV)
+            hsv2rgb(hueLerp( presets[presetA].h, presets[presetB].h, offset ),
+                    ILERP( presets[presetA].s, presets[presetB].s, offset, TRANSITION_BITS ),
+                    ILERP( presets[presetA].v, presets[presetB].v, offset, TRANSITION_BITS ),
+                    rgb);
+        else
+        {
+            int16_t lab[3];
+            oklabLerp(presetLab(presetA), presetLab(presetB), offset, activeTransitions.space==SPACE_OKLCH, lab);
+            oklabToRgb(lab, rgb);
+        }
+        ledFrameMake(frame, rgb[0], rgb[1], rgb[2]);
         return;
+    }
     
-    uint8_t presetA= activeTransitions.presetIndices[activeTransitions.index], 
-            presetB= activeTransitions.presetIndices[(activeTransitions.index+1)%activeTransitions.count];
-    uint8_t transIdx= transitionIndex(presetA, presetB);
-    struct hsv col;
-    col.h= hueLerp( presets[presetA].h, presets[presetB].h, activeTransitions.offset );
-    col.s= ILERP( presets[presetA].s, presets[presetB].s, activeTransitions.offset, TRANSITION_BITS );
-    col.v= ILERP( presets[presetA].v, presets[presetB].v, activeTransitions.offset, TRANSITION_BITS );
-    setLEDsHSV((uint16_t)col.h, (uint16_t)col.s, (uint16_t)col.v);
+    // each preset's weight falls off with its distance to the position on the walk,
+    // reaching 0 half way around
+    uint32_t position= ((uint32_t)activeTransitions.index<<TRANSITION_BITS) + activeTransitions.offset;
+    uint32_t half= (uint32_t)count<<(TRANSITION_BITS-1);
+    // in either OKLab space the weighted mean is taken in OKLab, a mean of hues
+    // in OKLCh would need the weights on the circle
+    bool lab= activeTransitions.space!=SPACE_HSV;
+    int32_t sum[3]= { 0, 0, 0 }, weights= 0;
+    for(uint8_t i= 0; i<count; ++i)
+    {
+        uint32_t d= position - ((uint32_t)i<<TRANSITION_BITS);
+        if((int32_t)d<0)
+            d= -d;
+        if(d>half)
+            d= 2*half-d;
+        uint16_t w= ease(activeTransitions.easing, 0xFFFF - (d*0xFFFF/half)) >> 4;
+        if(lab)
+        {
+            const int16_t *c= presetLab(activeTransitions.presetIndices[i]);
+            for(uint8_t k= 0; k<3; ++k)
+                sum[k]+= (int32_t)c[k]*w;
+        }
+        else
+        {
+            uint16_t rgb[3];
+            struct hsv *p= &presets[activeTransitions.presetIndices[i]];
+            hsv2rgb(p->h, p->s, p->v, rgb);
+            for(uint8_t k= 0; k<3; ++k)
+                sum[k]+= (int32_t)rgb[k]*w;
+        }
+        weights+= w;
+    }
+    if(!weights)
+        weights= 1;
+    uint16_t rgb[3];
+    if(lab)
+    {
+        int16_t c[3]= { sum[0]/weights, sum[1]/weights, sum[2]/weights };
+        oklabToRgb(c, rgb);
+    }
+    else
+        for(uint8_t k= 0; k<3; ++k)
+            rgb[k]= sum[k]/weights;
+    ledFrameMake(frame, rgb[0], rgb[1], rgb[2]);
+}
 
-    activeTransitions.offset+= transitionSettings[transIdx].velocity;
-    if(activeTransitions.offset>TRANSITION_MAX)
+// main loop part: keep the queue filled while two or more presets are held
+void transitionTask(void)
+{
+    while(activeTransitions.count>=2 && 
+          (uint8_t)(transitionQueue.head-transitionQueue.tail)<TRANSITION_QUEUE)
     {
-        activeTransitions.offset-= 1<<TRANSITION_BITS;
-        activeTransitions.index= (++activeTransitions.index)%activeTransitions.count;
+        struct ledFrame frame;
+        uint8_t a= activeTransitions.presetIndices[activeTransitions.index], 
+                b= activeTransitions.presetIndices[(activeTransitions.index+1)%activeTransitions.count];
+        
+        transitionColor(&frame);
+        transitionQueue.frames[transitionQueue.head%TRANSITION_QUEUE]= frame;
+        transitionQueue.head++;
+
+        activeTransitions.offset+= transitionSettings[transitionIndex(a, b)].velocity;
+        if(activeTransitions.offset>TRANSITION_MAX)
+        {
+            activeTransitions.offset-= 1<<TRANSITION_BITS;
+            activeTransitions.index= (activeTransitions.index+1)%activeTransitions.count;
+        }
     }
 }
 
-ISR(TIMER1_OVF_vect)
+// ISR part: show the next precomputed step
+static void transitionShow(void)
+{
+    if(transitionQueue.head==transitionQueue.tail)
+    {
+        if(activeTransitions.count>=2)
+            transitionQueue.underruns++;
+        return;
+    }
+    ledFrameShow(&transitionQueue.frames[transitionQueue.tail%TRANSITION_QUEUE]);
+    transitionQueue.tail++;
+}
+
+// keyframe timeline, played back from the overflow ISR one PWM period at a time
+#define TIMELINE_MAX        24
+#define PWM_PERIOD_US       ((RGB_MAX+1)/(F_CPU/1000000))  // at full resolution
+CASSERT(PWM_PERIOD_US==SCHED_TICK_US, schedTick);
+
+struct keyframe
+{
+    uint32_t time;          // us from the start
+    uint32_t recip;         // 2^32/length of the segment starting here, in us
+    uint16_t c[3];          // rgb or hsv
+    uint8_t hsv: 1;
+    uint8_t easing: 7;      // of the segment starting here
+};
+
+volatile struct
+{
+    struct keyframe frames[TIMELINE_MAX];
+    uint8_t count;
+    uint8_t playing;
+    uint8_t loop;
+    uint8_t index;          // current segment
+    uint32_t position;      // us into the timeline
+    uint32_t rate;          // timeline us per real us, 16.16 fixed point
+    uint16_t rateFrac;
+    uint32_t exposure;      // ms the whole timeline should take, 0 for recorded speed
+    uint16_t rgbA[3], rgbB[3];  // current segment's end points when lerping in rgb
+} timeline;
+
+void timelineClear(void)
+{
+    cli();
+    timeline.playing= timeline.count= 0;
+    sei();
+}
+
+// append a keyframe, times have to increase
+bool timelineAdd(uint32_t timeMs, uint8_t hsv, uint16_t c0, uint16_t c1, uint16_t c2, uint8_t easing)
+{
+    uint8_t n= timeline.count;
+    uint32_t t= timeMs*1000;
+    if(n>=TIMELINE_MAX || easing>=NEASINGS || timeMs>=(uint32_t)-1/1000 || timeline.playing)
+        return false;
+    if(n)
+    {
+        if(t<=timeline.frames[n-1].time)
+            return false;
+        timeline.frames[n-1].recip= 0xFFFFFFFFUL/(t-timeline.frames[n-1].time);
+    }
+    timeline.frames[n].time= t;
+    timeline.frames[n].hsv= hsv;
+    timeline.frames[n].easing= easing;
+    timeline.frames[n].c[0]= c0 & RGB_MAX;
+    timeline.frames[n].c[1]= c1 & RGB_MAX;
+    timeline.frames[n].c[2]= c2 & RGB_MAX;
+    timeline.count= n+1;
+    return true;
+}
+
+static void timelineEnterSegment(uint8_t index)
+{
+    volatile struct keyframe *a= &timeline.frames[index], *b= &timeline.frames[index+1];
+    timeline.index= index;
+    if(a->hsv && b->hsv)
+        return;
+    for(uint8_t i= 0; i<3; ++i)
+        timeline.rgbA[i]= a->c[i],
+        timeline.rgbB[i]= b->c[i];
+    if(a->hsv)
+        hsv2rgb(a->c[0], a->c[1], a->c[2], (uint16_t *)timeline.rgbA);
+    if(b->hsv)
+        hsv2rgb(b->c[0], b->c[1], b->c[2], (uint16_t *)timeline.rgbB);
+}
+
+bool timelineStart(bool loop)
+{
+    if(timeline.count<2)
+        return false;
+    // playback runs from the first keyframe to the last, not from 0
+    uint32_t length= (timeline.frames[timeline.count-1].time-timeline.frames[0].time)/1000;
+    uint64_t rate= 1UL<<16;
+    if(timeline.exposure)
+        rate= ((uint64_t)length<<16) / timeline.exposure;
+    if(!rate || rate>(32UL<<16))
+        return false;
+
+    cli();
+    timeline.rate= rate;
+    timeline.rateFrac= 0;
+    timeline.position= timeline.frames[0].time;
+    timeline.loop= loop;
+    timelineEnterSegment(0);
+    timeline.playing= 1;
+    sei();
+    // the transitions start over from nothing once the timeline stops
+    transitionReset();
+    return true;
+}
+
+void timelineStop(void)
+{
+    cli();
+    timeline.playing= 0;
+    sei();
+    setLEDs(0, 0, 0);
+}
+
+// called once per PWM period while playing
+void timelineStep(void)
+{
+    uint32_t advance= (uint32_t)PWM_PERIOD_US*timeline.rate + timeline.rateFrac;
+    timeline.position+= advance>>16;
+    timeline.rateFrac= advance;
+
+    uint8_t last= timeline.count-1;
+    while(timeline.position>=timeline.frames[timeline.index+1].time)
+    {
+        if(timeline.index+1<last)
+            timelineEnterSegment(timeline.index+1);
+        else if(timeline.loop)
+        {
+            timeline.position-= timeline.frames[last].time-timeline.frames[0].time;
+            timelineEnterSegment(0);
+        }
+        else
+        {
+            // done, the exposure ends dark
+            timeline.playing= 0;
+            setLEDs(0, 0, 0);
+            return;
+        }
+    }
+
+    volatile struct keyframe *a= &timeline.frames[timeline.index], *b= &timeline.frames[timeline.index+1];
+    uint16_t u= (timeline.position-a->time)*a->recip >> 16;
+    uint16_t e= ease(a->easing, u) >> 1;
+    if(a->hsv && b->hsv)
+        setLEDsHSV(hueLerp(a->c[0], b->c[0], e),
+                   ILERP((int32_t)a->c[1], (int32_t)b->c[1], e, TRANSITION_BITS),
+                   ILERP((int32_t)a->c[2], (int32_t)b->c[2], e, TRANSITION_BITS));
+    else
+        setLEDs(ILERP((int32_t)timeline.rgbA[0], (int32_t)timeline.rgbB[0], e, TRANSITION_BITS),
+                ILERP((int32_t)timeline.rgbA[1], (int32_t)timeline.rgbB[1], e, TRANSITION_BITS),
+                ILERP((int32_t)timeline.rgbA[2], (int32_t)timeline.rgbB[2], e, TRANSITION_BITS));
+}
+
+// binary color stream, double buffered between the CDC parser and the overflow ISR.
+// the parser fills the slot that isn't pending, the ISR shows the pending one at the
+// start of the next PWM period.
+#define STREAM_HOLD     200     // PWM periods the stream keeps the transitions off after a frame
+
+volatile struct
+{
+    int16_t rgb[2][3];
+    uint8_t pending;            // slot+1 of the frame to show next, 0 if none
+    uint8_t hold;               // countdown, transitions are paused while nonzero
+    uint8_t lastSeq;
+    uint16_t frames, crcErrors, lost, overruns;
+} colorStream;
+
+void streamQueue(int16_t r, int16_t g, int16_t b)
+{
+    uint8_t slot= colorStream.pending==1? 1: 0;
+    colorStream.rgb[slot][0]= r;
+    colorStream.rgb[slot][1]= g;
+    colorStream.rgb[slot][2]= b;
+    if(colorStream.pending)
+        colorStream.overruns++;
+    colorStream.pending= slot+1;
+}
+
+// shadow compare registers: setLEDs() only stores the values, the overflow ISR
+// writes all three early in the period and they take effect together at the next TOP.
+// the values carry DITHER_BITS below the PWM resolution; the ISR keeps the part that
+// didn't fit as a residual for the next period (first order sigma-delta), so over
+// 2^DITHER_BITS periods the average duty hits the fine value. the curve tables
+// are 16 bits, more dither bits would only spread their rounding error.
+// it runs on every overflow, so its cycles count in the STATS_TIMER1 slot of 'stats'.
+#define DITHER_BITS         2
+#define DITHER_MASK         ((1<<DITHER_BITS)-1)
+
+CASSERT(RGB_BITS+DITHER_BITS<=16, ditherBits);
+
+// PWM profiles trade resolution for frequency: Timer1/Timer3 count to 2^bits-1, so
+// 14 bits run at ~976 Hz and every bit less doubles that (10 bits: 15.6 kHz, 9 bits:
+// 31.25 kHz) for cameras with electronic shutters. the bits the profile drops are
+// dithered like DITHER_BITS. the ISR's per period work still runs every PWM_PERIOD_US,
+// i.e. every 2^(RGB_BITS-bits) overflows.
+#define PWM_MIN_BITS        9
+
+volatile struct
+{
+    uint16_t fine[3];       // RGB_BITS+DITHER_BITS
+    uint8_t residual[3];    // ISR only
+    uint8_t bits;           // active profile
+    uint8_t shift;          // fine value to compare value
+    uint8_t overflows;      // per PWM_PERIOD_US
+    uint8_t countdown;
+    uint8_t locked;         // pwmLock(), the periods' work waits
+    uint8_t missed;         // periods that came due while locked
+} pwmShadow= { .bits= RGB_BITS, .shift= DITHER_BITS, .overflows= 1, .countdown= 1 };
+
+CASSERT(RGB_BITS-PWM_MIN_BITS==5, pwmShifts);
+
+// inlined once per profile with a constant shift: a variable one is a loop on
+// the AVR, and with 9 bits the overflows come every 512 cycles
+static inline __attribute__((always_inline)) void pwmDither(uint16_t *v, uint8_t shift)
+{
+    for(uint8_t i= 0; i<3; ++i)
+    {
+        v[i]= pwmShadow.fine[i] + pwmShadow.residual[i];
+        if(v[i]<pwmShadow.residual[i])
+            v[i]= 0xFFFF;   // saturate at full scale
+        pwmShadow.residual[i]= v[i] & ((1<<shift)-1);
+        v[i]>>= shift;
+    }
+}
+
+// with interrupts disabled, the ISR nests into itself when its work spans overflows
+static void pwmCommit(void)
+{
+    uint16_t v[3];
+    cli();
+    switch(pwmShadow.shift)
+    {
+        case DITHER_BITS:   pwmDither(v, DITHER_BITS); break;
+        case DITHER_BITS+1: pwmDither(v, DITHER_BITS+1); break;
+        case DITHER_BITS+2: pwmDither(v, DITHER_BITS+2); break;
+        case DITHER_BITS+3: pwmDither(v, DITHER_BITS+3); break;
+        case DITHER_BITS+4: pwmDither(v, DITHER_BITS+4); break;
+        default:            pwmDither(v, DITHER_BITS+5); break;
+    }
+    OCR1A= v[0];
+    OCR1B= v[1];
+    OCR3A= v[2];
+    sei();
+}
+
+// switch to 'bits' of resolution. both timers are halted and restarted in lockstep;
+// the old compare values apply for the first period.
+bool pwmSetProfile(uint8_t bits)
 {
-    static volatile uint8_t countdown= 10;
+    if(bits<PWM_MIN_BITS || bits>RGB_BITS)
+        return false;
+    uint16_t top= (1<<bits)-1;
+    cli();
+    GTCCR= (1<<TSM) | (1<<PSRSYNC);
+    ICR1= top;
+    ICR3= top;
+    TCNT1= 0;
+    TCNT3= 0;
+    pwmShadow.bits= bits;
+    pwmShadow.shift= DITHER_BITS + RGB_BITS-bits;
+    pwmShadow.overflows= pwmShadow.countdown= 1<<(RGB_BITS-bits);
+    pwmShadow.residual[0]= pwmShadow.residual[1]= pwmShadow.residual[2]= 0;
+    GTCCR= 0;
+    sei();
+    return true;
+}
+
+// per PWM period work
+static void pwmPeriod(void)
+{
+    static volatile uint8_t countdown= TRANSITION_PERIODS;
+    SCHED_TICK();
+    buttonTick();
+    if(settingsCountdown && !--settingsCountdown)
+        settingsDue= true;
+    if(colorStream.pending)
+    {
+        volatile int16_t *rgb= colorStream.rgb[colorStream.pending-1];
+        setLEDs(rgb[0], rgb[1], rgb[2]);
+        colorStream.pending= 0;
+        colorStream.hold= STREAM_HOLD;
+    }
+    if(colorStream.hold)
+    {
+        colorStream.hold--;
+        return;
+    }
+    if(timeline.playing)
+    {
+        timelineStep();
+        return;
+    }
     if(!--countdown)
     {
-        lerpTransitions();
-        countdown= 10;
+        transitionShow();
+        countdown= TRANSITION_PERIODS;
+    }
+}
+
+// dragAction() shares its state with the per period work of the Timer1 overflow
+// ISR only, and the short sections it shares with the button and ADB interrupts
+// guard themselves. holding back just that work keeps USB, ADB and the PWM
+// running while it works; the ISR still counts the overflows, so no period is
+// lost however long dragAction() takes, and the ones that came due are caught up on.
+static inline void pwmLock(void)
+{
+    pwmShadow.locked= 1;
+}
+
+static void pwmUnlock(void)
+{
+    for(;;)
+    {
+        cli();
+        if(!pwmShadow.missed)
+            break;
+        pwmShadow.missed--;
+        sei();
+        pwmPeriod();
+    }
+    pwmShadow.locked= 0;
+    sei();
+}
+
+// interruptible so the ADB edge timing isn't thrown off by the color math
+ISR(TIMER1_OVF_vect)
+{
+    STATS_OVERFLOW(ICR1);
+    sei();
+    STATS_BEGIN(STATS_TIMER1);
+    if(!--pwmShadow.countdown)
+    {
+        pwmShadow.countdown= pwmShadow.overflows;
+        if(pwmShadow.locked)
+            pwmShadow.missed++;
+        else
+            pwmPeriod();
     }
+    pwmCommit();
+    STATS_END(STATS_TIMER1);
 }
 
 // timer1: fast pwm mode
@@ -245,6 +975,8 @@ ISR(TIMER1_OVF_vect)
 //  OC3A: PC6=D5=BLUE
 void setupPWM(void)
 {
+    GTCCR= (1<<TSM) | (1<<PSRSYNC);         // halt the timers while they are set up
+    
     TCCR1A= (1<<COM1A1) | (1<<COM1B1) |     // Clear OC1A/OC1B on compare match, set OC1A/OC1B at TOP
             (1<<WGM11);                     // Fast PWM
     TCCR1B= (1<<WGM13) | (1<<WGM12) |       // Fast PWM, TOP=ICR1
@@ -263,15 +995,119 @@ void setupPWM(void)
     OCR1A= 2048;    // initial RED
     OCR1B= 6144;    // initial GREEN
     OCR3A= 0;       // initial BLUE
+    
+    TCNT1= 0;
+    TCNT3= 0;
+    GTCCR= 0;       // release both timers in lockstep, they share TOP from here on
+}
+
+// brightness curves between the color math and the PWM.
+// 64 segments over the RGB_BITS input with linear interpolation in between,
+// 16-bit output. the tables are computed by the compiler from the formulas below.
+#define CURVE_SEGMENT_BITS  8
+#define CURVE_POINTS        ((1<<(RGB_BITS-CURVE_SEGMENT_BITS))+1)
+
+enum curveType
+{
+    CURVE_LINEAR,
+    CURVE_CIE,          // CIE 1976 L* -> luminance, even perceived steps
+    CURVE_GAMMA22,      // power law, gamma 2.2
+    NCURVES
+};
+
+#define CURVE_X(i)          ((double)(i)/(CURVE_POINTS-1))
+#define CURVE_CIE_Y(x)      ((x)>0.08? ((x)*100+16)/116 * ((x)*100+16)/116 * ((x)*100+16)/116: (x)*100/903.3)
+#define CURVE_ENTRY(y)      (uint16_t)((y)*65535+0.5)
+#define CURVE_CIE_AT(i)     CURVE_ENTRY(CURVE_CIE_Y(CURVE_X(i)))
+#define CURVE_GAMMA22_AT(i) CURVE_ENTRY(__builtin_pow(CURVE_X(i), 2.2))
+#define CURVE_ROW(F, i)     F(i), F(i+1), F(i+2), F(i+3), F(i+4), F(i+5), F(i+6), F(i+7)
+#define CURVE_TABLE(F)      { CURVE_ROW(F, 0), CURVE_ROW(F, 8), CURVE_ROW(F, 16), CURVE_ROW(F, 24), \
+                              CURVE_ROW(F, 32), CURVE_ROW(F, 40), CURVE_ROW(F, 48), CURVE_ROW(F, 56), F(64) }
+
+CASSERT(CURVE_POINTS==65, curvePoints);
+
+// indexed by curveType-1, linear needs no table
+static const uint16_t curveTables[NCURVES-1][CURVE_POINTS] PROGMEM=
+{
+    CURVE_TABLE(CURVE_CIE_AT),
+    CURVE_TABLE(CURVE_GAMMA22_AT),
+};
+
+// per channel curve and full scale output, to match the dies' different resistor networks
+struct channelCurve
+{
+    uint8_t curve;
+    uint16_t max;
+};
+volatile struct channelCurve channelCurves[3]=
+{
+    { CURVE_CIE, RGB_MAX }, { CURVE_CIE, RGB_MAX }, { CURVE_CIE, RGB_MAX },
+};
+
+// map a linear RGB_BITS channel value to its PWM value, with DITHER_BITS fractional bits
+uint16_t curveApply(uint8_t channel, int16_t x)
+{
+    uint8_t curve= channelCurves[channel].curve;
+    uint16_t y;
+    CLAMP(x, 0, RGB_MAX);
+    if(curve==CURVE_LINEAR)
+        y= x << (16-RGB_BITS);
+    else
+    {
+        // stretch 0..RGB_MAX onto 0..RGB_MAX+1 so full input lands on the last point
+        uint16_t xs= x + (x >> (RGB_BITS-1));
+        const uint16_t *table= curveTables[curve-1];
+        uint8_t i= xs >> CURVE_SEGMENT_BITS;
+        uint8_t frac= xs & ((1<<CURVE_SEGMENT_BITS)-1);
+        uint16_t y0= pgm_read_word(&table[i]);
+        if(i==CURVE_POINTS-1)
+            y= y0;
+        else
+            y= y0 + ((uint32_t)(pgm_read_word(&table[i+1])-y0)*frac >> CURVE_SEGMENT_BITS);
+    }
+    return ((uint32_t)y*channelCurves[channel].max + (0x8000>>DITHER_BITS)) >> (16-DITHER_BITS);
+}
+
+// last color set, before the calibration and the curves
+volatile int16_t ledValues[3];
+
+CASSERT(CAL_RGB_MAX==RGB_MAX, calibrationRange);
+
+void ledFrameMake(struct ledFrame *frame, int16_t r, int16_t g, int16_t b)
+{
+    int16_t rgb[3]= { r, g, b };
+    frame->rgb[0]= r; frame->rgb[1]= g; frame->rgb[2]= b;
+    calibrate(rgb);
+    for(uint8_t i= 0; i<3; ++i)
+        frame->fine[i]= curveApply(i, rgb[i]);
+}
+
+// hand a frame to the PWM, it is latched by the next overflow ISR
+void ledFrameShow(const volatile struct ledFrame *frame)
+{
+    uint8_t sreg= SREG;
+    cli();
+    for(uint8_t i= 0; i<3; ++i)
+        ledValues[i]= frame->rgb[i],
+        pwmShadow.fine[i]= frame->fine[i];
+    SREG= sreg;
 }
 
 void setLEDs(int16_t r, int16_t g, int16_t b)
 {
-    OCR1A= r;
-    OCR1B= g;
-    OCR3A= b;
+    struct ledFrame frame;
+    ledFrameMake(&frame, r, g, b);
+    ledFrameShow(&frame);
 }
 
+#define HUE_SECTOR          ((HSV_MAX+1)/6)     // hue range between two interp[] entries
+#define HUE_SECTOR_RECIP    24583               // ceil(2^26/HUE_SECTOR), h*this>>26 == h/HUE_SECTOR for all 14-bit h
+
+// the division free hue math below depends on these
+CASSERT(HUE_SECTOR==2730, hueSector);
+CASSERT(HSV_MAX/6==HUE_SECTOR, hueDivisor);
+CASSERT(HSV_MAX==6*HUE_SECTOR+3, hueRemainder);
+
 void hsv2rgb(int h, int s, int v, uint16_t *dest)
 {
     struct rgb
@@ -279,27 +1115,39 @@ void hsv2rgb(int h, int s, int v, uint16_t *dest)
         int16_t r, g, b;
     };
 
-    static struct rgb interp[7]=  { { HSV_MAX, 0, 0 },           // red
+    static const struct rgb interp[8] PROGMEM=
+                                { { HSV_MAX, 0, 0 },           // red
                                   { HSV_MAX, 0, HSV_MAX },       // red/blue
                                   { 0, 0, HSV_MAX },             // blue
                                   { 0, HSV_MAX, HSV_MAX },       // blue/green
                                   { 0, HSV_MAX, 0},              // green
                                   { HSV_MAX, HSV_MAX, 0},        // green/red
-                                  { HSV_MAX, 0, 0 } };           // red
-    int index;    // table index
-    int offset;   // between entries
+                                  { HSV_MAX, 0, 0 },             // red
+                                  { HSV_MAX, 0, HSV_MAX } };     // red/blue, for the 4 hues above 6*HUE_SECTOR
+    uint8_t index;      // table index
+    uint16_t offset;    // between entries
+    uint16_t ramp;      // offset scaled to 0..HSV_MAX
     uint32_t r, g, b;
     
     CLAMP(v, 0, HSV_MAX);
     h&= HSV_MAX;                   // modulo with max value
     s= (HSV_MAX+1)-s;              // invert saturation
-    index= h / ((HSV_MAX+1)/6);    // calculate table index
-    offset= h % ((HSV_MAX+1)/6);   // and lerp offset
+    index= (uint32_t)h*HUE_SECTOR_RECIP >> 26;     // calculate table index
+    offset= h - index*HUE_SECTOR;                   // and lerp offset
     
-    // hue
-    r= interp[index].r + (int32_t)(interp[index+1].r-interp[index].r)*offset/(HSV_MAX/6);
-    g= interp[index].g + (int32_t)(interp[index+1].g-interp[index].g)*offset/(HSV_MAX/6);
-    b= interp[index].b + (int32_t)(interp[index+1].b-interp[index].b)*offset/(HSV_MAX/6);
+    // hue: each channel is constant or ramps by offset*HSV_MAX/HUE_SECTOR.
+    // HSV_MAX is 6*HUE_SECTOR+3 and HUE_SECTOR is 3*910, so that's exactly this:
+    ramp= offset*6 + (offset>=910) + (offset>=1820);
+    #define HUE_CHANNEL(c)                                                  \
+    ({                                                                      \
+        int16_t a= pgm_read_word(&interp[index].c),                         \
+                b= pgm_read_word(&interp[index+1].c);                       \
+        (uint32_t)(b>a? a+ramp: b<a? a-ramp: a);                            \
+    })
+    r= HUE_CHANNEL(r);
+    g= HUE_CHANNEL(g);
+    b= HUE_CHANNEL(b);
+    #undef HUE_CHANNEL
 
     // value
     r= (int32_t)(r)*v>>HSV_BITS;
@@ -360,7 +1208,9 @@ void dragAction(uint16_t motionBeginX, uint16_t motionBeginY, uint16_t currentX,
         uint8_t settingIdx= transitionIndex(a, b);
         int16_t vel= transitionSettings[settingIdx].velocity + (relY>>1);
         CLAMP(vel, 0, TRANSITION_MAX);
-        transitionSettings[settingIdx].velocity= vel;
+        if(transitionSettings[settingIdx].velocity!=vel)
+            transitionSettings[settingIdx].velocity= vel,
+            settingsChanged();
         //~ printf("transition: %d -> %d setting idx %d vel %d\n", a, b, settingIdx, transitionSettings[settingIdx].velocity);
         return;
     }
@@ -372,11 +1222,7 @@ void dragAction(uint16_t motionBeginX, uint16_t motionBeginY, uint16_t currentX,
         ls= presets[button-1].s,
         lv= presets[button-1].v;
 
-    int16_t arelY= relY;
-    //~ const int16_t scaling[][2]= { { 20, 2 }, { 40, 4 }, { 80, 6 }, { 160, 8 }, { 320, 20 } };
-    //~ for(int8_t i= sizeof(scaling)/sizeof(scaling[0])-1; i>=0; --i)
-        //~ if(abs(relY)>scaling[i][0]) { arelY*= scaling[i][1]; break; }
-    //~ printf("arelY: %d\n", arelY);
+    int16_t arelY= relY;    // already filtered and accelerated, see motionParams
     
     if(motionBeginX<BOUNDARY1)
     {
@@ -396,10 +1242,11 @@ void dragAction(uint16_t motionBeginX, uint16_t motionBeginY, uint16_t currentX,
         ls+= arelY;
         CLAMP(ls, 0, HSV_MAX);
     }
-    if(button)
+    if(button && (presets[button-1].h!=lh || presets[button-1].s!=ls || presets[button-1].v!=lv))
         presets[button-1].h= lh,
         presets[button-1].s= ls,
-        presets[button-1].v= lv;
+        presets[button-1].v= lv,
+        settingsChanged();
 
     setLEDsHSV(lh, ls, lv);
 }
@@ -407,9 +1254,11 @@ void dragAction(uint16_t motionBeginX, uint16_t motionBeginY, uint16_t currentX,
 // app setup
 void setup(void)
 {
+    settingsLoad();
     touchpadTimerSetup();
     Delay_MS(200);  // wait a bit -- the touchpad seems to take a while to power up
     touchpadInitADB();
+    adbAsyncSetup();
     setupPWM();
     buttonSetup();
     
@@ -427,6 +1276,17 @@ void setup(void)
     dragAction((TOUCHPAD_XMIN-TOUCHPAD_XMIN)/2, (TOUCHPAD_YMIN-TOUCHPAD_YMIN)/2, (TOUCHPAD_XMIN-TOUCHPAD_XMIN)/2, (TOUCHPAD_YMIN-TOUCHPAD_YMIN)/2, 
                 0, 0, 100, 
                 0/*buttons*/, 0/*isBegin*/, 1/*isEnd*/);
+    
+    // the touchpad answers a poll after 2-6 ms, picking it up within 1 ms keeps the
+    // motion filter's timestamps tight; the transition queue lasts 40 ms;
+    // an EEPROM byte takes 3.4 ms to write
+    touchpadTaskId= schedAdd(PSTR("touchpad"), touchpadTask, SCHED_MS(1));
+    schedAdd(PSTR("buttons"), buttonTask, SCHED_MS(1));
+    schedAdd(PSTR("transitions"), transitionTask, SCHED_MS(5));
+    schedAdd(PSTR("settings"), settingsTask, SCHED_MS(4));
+    schedAdd(PSTR("status"), statusTask, SCHED_MS(STATUS_TASK_MS));
+    // the vendor interface moves a packet each way per USB frame
+    schedAdd(PSTR("vendor"), vendorTask, SCHED_MS(1));
 }
 
 
@@ -437,6 +1297,18 @@ void buttonChange(uint8_t lastButtons, uint8_t buttons)
     uint8_t buttonsReleased= (lastButtons ^ buttons) & lastButtons;
     uint8_t buttonsDown= 0;
     uint8_t singleButton;
+
+    // all buttons together start/stop the timeline, which owns the LEDs while it plays
+    if(buttons==(1<<NBUTTONS)-1 && buttonsPressed && timeline.count>1)
+    {
+        if(timeline.playing)
+            timelineStop();
+        else
+            timelineStart(timeline.loop);
+    }
+    if(timeline.playing)
+        return;
+
     for(int i= 0; i<NBUTTONS; ++i)
     {
         if(buttons & (1<<i))
@@ -455,74 +1327,216 @@ void buttonChange(uint8_t lastButtons, uint8_t buttons)
 }
 
 
-void tick(void)
+static uint8_t buttonState;                 // as far as buttonChange() knows
+uint16_t buttonLatency;                     // longest time from an edge to buttonChange(), in ticks
+
+// a change of the held buttons, live from buttonTask() or from a trace
+void buttonApply(uint8_t buttons)
 {
-    //~ setLEDs(RGB_MAX,RGB_MAX,RGB_MAX);
-    //~ setLEDs(RGB_MAX/2,RGB_MAX/2,RGB_MAX/2);
-    //~ setLEDs(0,0,0);
-    //~ return; ///////////////////////////////////
-    
-    static uint8_t wasDown;
+    buttonChange(buttonState, buttons);
+    buttonState= buttons;
+    touchpadWake();
+}
+
+// hand the queued button events to buttonChange() in order
+void buttonTask(void)
+{
+    while(buttonEvents.tail!=buttonEvents.head)
+    {
+        uint8_t tail= buttonEvents.tail;
+        uint8_t buttons= buttonEvents.events[tail%BUTTON_EVENTS].buttons;
+        uint16_t latency= schedTime() - buttonEvents.events[tail%BUTTON_EVENTS].time;
+        buttonEvents.tail= tail+1;
+        if(latency>buttonLatency)
+            buttonLatency= latency;
+        traceButtons(buttons);
+        buttonApply(buttons);
+    }
+}
+
+// back to polling every millisecond
+void touchpadWake(void)
+{
+    touchpadActive= schedTime();
+    if(touchpadIdle)
+    {
+        touchpadIdle= 0;
+        schedSetPeriod(touchpadTaskId, SCHED_MS(1));
+    }
+}
+
+// checked at least every TOUCHPAD_IDLE_PERIOD_1, long before the difference wraps
+static void touchpadBackoff(void)
+{
+    uint16_t idle= schedTime() - touchpadActive;
+    if(touchpadIdle<2 && idle>=TOUCHPAD_IDLE_AFTER_2)
+        touchpadIdle= 2;
+    else if(touchpadIdle<1 && idle>=TOUCHPAD_IDLE_AFTER_1)
+        touchpadIdle= 1;
+}
+
+static uint8_t touchpadDown;                // a pad is being touched
+
+// one report from an ADB device, live from touchpadTask() or from a trace
+void touchpadReport(uint8_t device, const uint8_t *data, int8_t length)
+{
+    static uint8_t pad;                     // index of the pad in adbBus.devices
     static uint16_t motionBeginX, motionBeginY;
     static uint16_t lastX, lastY;
-    static uint8_t lastButtonState;
-    
-    uint8_t buttons= buttonRead();
-    if(buttons!=lastButtonState)
+    static struct motionFilter motion;
+    uint8_t buttons= buttonState;
+    struct adbAbsMode absData;
+
+    if(length<0)
     {
-        buttonChange(lastButtonState, buttons);
-        
-        lastButtonState= buttons;
+        puts("error polling adb");
+        return;
     }
-        
-    
-    uint8_t adbData[8];
-    struct adbAbsMode absData;
-    cli();
-    //~ touchpadInitADB();
-    char res= adbPoll(adbData);
-    sei();
-    if(res)
+    // a second pad's reports wait until the first one is let go
+    if(!length || device>=adbBus.count || adbBus.devices[device].kind!=ADB_KIND_PAD ||
+       (touchpadDown && device!=pad))
+        return;
+    pad= device;
+    adbGetAbsModeData(&absData, data);
+    if(absData.pressure && absData.xpos && absData.ypos)
     {
-        if(res<0)
-            puts("error polling adb");
-        else
+        int16_t rel[2];
+        if(!touchpadDown)
+            motionBeginX= absData.xpos,
+            motionBeginY= absData.ypos,
+            motionReset(&motion);
+        motionUpdate(&motion, &motionParams, absData.xpos, absData.ypos, schedTime(), rel);
+        lastX= motionPosition(&motion, 0);
+        lastY= motionPosition(&motion, 1);
+        pwmLock();
+        STATS_BEGIN(STATS_PWM_LOCK);
+        dragAction(motionBeginX, motionBeginY, lastX, lastY, 
+                    rel[0], rel[1], absData.pressure, 
+                    buttons, !touchpadDown/*isBegin*/, 0/*isEnd*/);
+        STATS_END(STATS_PWM_LOCK);
+        pwmUnlock();
+        touchpadDown= 1;
+        touchpadWake();
+    }
+    else
+    {
+        if(touchpadDown)
         {
-            adbGetAbsModeData(&absData, adbData);
-            if(absData.pressure && absData.xpos && absData.ypos)
-            {
-                if(!wasDown)
-                    motionBeginX= absData.xpos,
-                    motionBeginY= absData.ypos;
-                cli();
-                dragAction(motionBeginX, motionBeginY, absData.xpos, absData.ypos, 
-                            (wasDown? absData.xpos-lastX: 0), (wasDown? absData.ypos-lastY: 0), absData.pressure, 
-                            buttons, !wasDown/*isBegin*/, 0/*isEnd*/);
-                sei();
-                wasDown= 1;
-                lastX= absData.xpos;
-                lastY= absData.ypos;
-            }
-            else
-            {
-                if(wasDown)
-                {
-                    cli();
-                    dragAction(motionBeginX, motionBeginY, lastX, lastY, 0, 0, 0, 
-                                buttons/*buttons*/, 0/*isBegin*/, 1/*isEnd*/);
-                    sei();
-                }
-                wasDown= 0;
-            }
+            pwmLock();
+            STATS_BEGIN(STATS_PWM_LOCK);
+            dragAction(motionBeginX, motionBeginY, lastX, lastY, 0, 0, 0, 
+                        buttons/*buttons*/, 0/*isBegin*/, 1/*isEnd*/);
+            STATS_END(STATS_PWM_LOCK);
+            pwmUnlock();
         }
+        touchpadDown= 0;
     }
 }
 
+// pick up the last touchpad poll and start the next one
+void touchpadTask(void)
+{
+    static uint8_t polling;
+    uint8_t adbData[8], device;
+    if(!polling)
+    {
+        // backed off: poll now, look for the answer every millisecond
+        adbBusPollStart();
+        polling= 1;
+        schedSetPeriod(touchpadTaskId, SCHED_MS(1));
+        return;
+    }
+    int8_t res= adbBusPollResult(adbData, &device);
+    if(res==ADB_BUSY)
+        return;
+    polling= 0;
+    // another device has a report
+    if(adbBus.srq)
+        touchpadWake();
+    // start the next poll right away, it runs while we work on this one
+    if(!touchpadIdle)
+        adbBusPollStart(),
+        polling= 1;
+    if(res>0)
+        traceAdb(device, adbData, res);
+    touchpadReport(device, adbData, res);
+    if(!touchpadDown)
+        touchpadBackoff();
+    if(touchpadIdle && !polling)
+        schedSetPeriod(touchpadTaskId, touchpadIdle==1? TOUCHPAD_IDLE_PERIOD_1: TOUCHPAD_IDLE_PERIOD_2);
+}
+
+// true if 'line' is the command word 'cmd', optionally followed by arguments
+static bool isCommand(const char *line, const char *cmd)
+{
+    uint8_t n= strlen(cmd);
+    return !strncmp(line, cmd, n) && (line[n]==' ' || !line[n]);
+}
+
+// parse up to 'max' space separated integers after the command word,
+// returns how many were found
+static uint8_t commandArgs(const char *line, int32_t *args, uint8_t max)
+{
+    uint8_t n= 0;
+    const char *p= strchr(line, ' ');
+    while(p && n<max)
+    {
+        char *end;
+        int32_t v= strtol(p, &end, 0);
+        if(end==p)
+            break;
+        args[n++]= v;
+        p= end;
+    }
+    return n;
+}
+
+// commands:
+//  R, G, B, W, OFF             full single color / white / off
+//  curve <ch> <type> [max]     brightness curve for channel 0-2 (r, g, b):
+//                              type 0 linear, 1 CIE L*, 2 gamma 2.2; max is the full scale PWM value
+//  kf <ms> <type> <c0> <c1> <c2> [easing]
+//                              append a timeline keyframe: type 0 RGB, 1 HSV; easing of the following
+//                              segment 0 linear, 1 in, 2 out, 3 in/out, 4 cubic, 5 hold
+//  kfclear                     delete all keyframes
+//  play [loop]                 play the timeline, loop if the argument is 1. all four buttons toggle it too
+//  stop                        stop playing
+//  exposure <ms>               stretch or squeeze the timeline to this length, 0 for recorded speed
+//  blend <mode> [easing] [space]
+//                              transitions between held presets: mode 0 rotates from one to the next,
+//                              1 blends all of them with weights that follow the rotation. easing as for kf.
+//                              space 0 interpolates in HSV, 1 in OKLab, 2 in OKLCh (the blend uses OKLab)
+//  stats [reset]               cycle counts of the ISRs and main loop parts (builds with ENABLE_STATS only):
+//                              name, count, min, avg, max, 0.1% of the time since reset, histogram from 16 cycles up
+//  tasks [reset]               main loop tasks: name, period in ~ms ticks, runs, max lateness in ticks, overruns
+//  trace <1|0>                 start/stop recording buttons, ADB reports and received bytes as
+//                              binary records on the serial port, see trace.h and host/lptrace
+//  adb                         ADB devices: address, power-on address, handler, kind, reports; poll counts
+//  power [reset]               time since reset and the share the CPU was awake / in idle sleep.
+//                              either reset clears the task and the power counters
+//  motion <mincutoff> <beta> [dcutoff]
+//                              touchpad filter: cutoffs in Hz*256, beta in Hz*256 per 256 units/s
+//  accel <lowspeed> <lowgain> <highspeed> <highgain>
+//                              touchpad acceleration: speeds in units/s, gains in 1/16
+//  pwm <bits>                  PWM resolution 9-14, less bits run faster: 14 ~976 Hz, 10 15.6 kHz, 9 31.25 kHz
+//  cal                         color calibration: matrix row and offset per output channel, white point
+//  cal <channel> <r> <g> <b> [offset]
+//                              matrix row of an output channel on RGB before the curves linearize it,
+//                              4096 is 1.0, -16384..16384; the offset in RGB units is added after it
+//  cal reset                   identity matrix, no offsets, no white point
+//  white <kelvin>              scale the channels to the white of a black body at 1000..12000 K, 0 for none
+//  reset, r                    reset into the bootloader
+// a listing longer than the send ring goes out a row at a time, each once the
+// ring is empty, as printing never waits for the host. meanwhile no input is
+// taken, the host's packets wait in the USB bank
+static bool (*listing)(uint8_t row);
+static uint8_t listingRow;
+
 bool ProcessCDCLine(const char *line)
 {
-    statusLED(true);
-    Delay_MS(100);
-    statusLED(false);
+    int32_t args[6];
+
+    statusBlink();
     if(!strcmp(line, "R"))
         setLEDs(RGB_MAX, 0, 0);
     else if(!strcmp(line, "G"))
@@ -533,6 +1547,119 @@ bool ProcessCDCLine(const char *line)
         setLEDs(RGB_MAX, RGB_MAX, RGB_MAX);
     else if(!strcmp(line, "OFF"))
         setLEDs(0, 0, 0);
+    else if(isCommand(line, "curve"))
+    {
+        uint8_t n= commandArgs(line, args, 3);
+        if(n<2 || args[0]<0 || args[0]>2 || args[1]<0 || args[1]>=NCURVES)
+            return false;
+        channelCurves[args[0]].curve= args[1];
+        if(n>2)
+            channelCurves[args[0]].max= min(max(args[2], 0), RGB_MAX);
+        setLEDs(ledValues[0], ledValues[1], ledValues[2]);
+    }
+    else if(!strcmp(line, "cal"))
+        listing= calibrationPrint;
+    else if(!strcmp(line, "cal reset") || isCommand(line, "cal") || isCommand(line, "white"))
+    {
+        uint8_t n= commandArgs(line, args, 5);
+        if(!strcmp(line, "cal reset"))
+            calibrationReset(&calibration);
+        else if(isCommand(line, "white"))
+        {
+            if(n<1 || (args[0] && (args[0]<CAL_KELVIN_MIN || args[0]>CAL_KELVIN_MAX)))
+                return false;
+            calibration.kelvin= args[0];
+        }
+        else
+        {
+            if(n<4 || args[0]<0 || args[0]>2)
+                return false;
+            for(uint8_t k= 0; k<3; ++k)
+                calibration.matrix[args[0]][k]= max(min(args[1+k], CAL_LIMIT), -CAL_LIMIT);
+            if(n>4)
+                calibration.offset[args[0]]= max(min(args[4], RGB_MAX), -RGB_MAX);
+        }
+        calibrationApply();
+        cli();
+        settingsChanged();
+        sei();
+        setLEDs(ledValues[0], ledValues[1], ledValues[2]);
+    }
+    else if(isCommand(line, "kf"))
+    {
+        uint8_t n= commandArgs(line, args, 6);
+        if(n<5 || args[0]<0 || (args[1]&~1) ||
+           !timelineAdd(args[0], args[1], args[2], args[3], args[4], n>5? args[5]: EASE_LINEAR))
+            return false;
+    }
+    else if(!strcmp(line, "kfclear"))
+        timelineClear();
+    else if(isCommand(line, "play"))
+        return timelineStart(commandArgs(line, args, 1) && args[0]==1);
+    else if(!strcmp(line, "stop"))
+        timelineStop();
+    else if(isCommand(line, "exposure"))
+    {
+        if(!commandArgs(line, args, 1) || args[0]<0)
+            return false;
+        timeline.exposure= args[0];
+    }
+    else if(isCommand(line, "blend"))
+    {
+        uint8_t n= commandArgs(line, args, 3);
+        if(!n || args[0]<0 || args[0]>=NTRANSITIONMODES || (n>1 && (args[1]<0 || args[1]>=NEASINGS)) ||
+           (n>2 && (args[2]<0 || args[2]>=NTRANSITIONSPACES)))
+            return false;
+        activeTransitions.mode= args[0];
+        activeTransitions.easing= n>1? args[1]: EASE_LINEAR;
+        activeTransitions.space= n>2? args[2]: SPACE_HSV;
+        transitionFlush();
+    }
+    else if(isCommand(line, "motion"))
+    {
+        uint8_t n= commandArgs(line, args, 3);
+        if(n<2 || args[0]<1 || args[0]>0xFFFF || args[1]<0 || args[1]>0xFFFF || (n>2 && (args[2]<1 || args[2]>MOTION_MAX_CUTOFF)))
+            return false;
+        motionParams.minCutoff= args[0];
+        motionParams.beta= args[1];
+        if(n>2)
+            motionParams.dCutoff= args[2];
+    }
+    else if(isCommand(line, "accel"))
+    {
+        if(commandArgs(line, args, 4)<4 || args[0]<0 || args[2]<=args[0] || args[2]>0xFFFF ||
+           args[1]<0 || args[1]>255 || args[3]<0 || args[3]>255)
+            return false;
+        motionParams.accelLowSpeed= args[0];
+        motionParams.accelLowGain= args[1];
+        motionParams.accelHighSpeed= args[2];
+        motionParams.accelHighGain= args[3];
+    }
+    else if(!strcmp(line, "tasks"))
+        listing= schedPrint;
+    else if(!strcmp(line, "tasks reset") || !strcmp(line, "power reset"))
+        schedReset();
+    else if(!strcmp(line, "power"))
+        schedPrintPower();
+    else if(!strcmp(line, "adb"))
+        listing= adbBusPrint;
+    else if(isCommand(line, "trace"))
+    {
+        if(commandArgs(line, args, 1)<1)
+            return false;
+        if(args[0])
+            traceStart();
+        else
+            traceStop();
+    }
+#ifdef ENABLE_STATS
+    else if(!strcmp(line, "stats"))
+        listing= statsPrint;
+    else if(!strcmp(line, "stats reset"))
+        statsReset();
+#endif
+    else if(isCommand(line, "pwm"))
+        return commandArgs(line, args, 1) && args[0]>=0 && args[0]<=RGB_BITS && pwmSetProfile(args[0]);
     else if(!strcmp(line, "reset") || !strcmp(line, "r"))
         RESET_PORT&= ~(1<<RESET_PIN);
     else
@@ -541,20 +1668,137 @@ bool ProcessCDCLine(const char *line)
     return true;
 }
 
-void ProcessCDCChar(uint8_t c)
+// binary color frame, sent instead of a text line:
+//  0xA5, sequence number, type (0: RGB, 1: HSV), 3 channels as 14-bit little endian words,
+//  CRC-8 (polynomial 0x07, init 0) over everything between the sync byte and the CRC.
+// frames are shown from the start of the next PWM period, and pause the transitions
+// for STREAM_HOLD periods. the sync byte can't be part of a text line, it starts a
+// frame wherever it comes.
+#define STREAM_SYNC         0xA5
+#define STREAM_FRAME_LEN    10
+#define STREAM_RGB          0
+#define STREAM_HSV          1
+
+// false if the CRC doesn't match
+bool ProcessStreamFrame(const uint8_t *frame)
+{
+    uint8_t crc= 0;
+    for(uint8_t i= 1; i<STREAM_FRAME_LEN-1; ++i)
+        crc= _crc8_ccitt_update(crc, frame[i]);
+    if(crc!=frame[STREAM_FRAME_LEN-1])
+    {
+        colorStream.crcErrors++;
+        return false;
+    }
+
+    uint8_t seq= frame[1];
+    if(colorStream.frames)
+        colorStream.lost+= (uint8_t)(seq-colorStream.lastSeq-1);
+    colorStream.lastSeq= seq;
+    colorStream.frames++;
+
+    uint16_t c[3];
+    for(uint8_t i= 0; i<3; ++i)
+        c[i]= (frame[3+i*2] | (frame[4+i*2]<<8)) & RGB_MAX;
+    if(frame[2]==STREAM_HSV)
+        hsv2rgb(c[0], c[1], c[2], c);
+    streamQueue(c[0], c[1], c[2]);
+    return true;
+}
+
+// main loop part: color frames from the vendor interface's OUT packets, then a
+// fresh status report for its IN endpoint. frames sit back to back, anything but
+// the sync byte where the next one would start is padding
+void vendorTask(void)
+{
+    static uint8_t sequence;
+    uint8_t packet[VENDOR_EPSIZE];
+    int8_t length;
+    while((length= vendorGet(packet))>=0)
+        for(uint8_t i= 0; i+STREAM_FRAME_LEN<=length && packet[i]==STREAM_SYNC; i+= STREAM_FRAME_LEN)
+            ProcessStreamFrame(packet+i);
+
+    struct vendorReport report=
+    {
+        .type= VENDOR_REPORT_STATUS,
+        .sequence= sequence++,
+        .time= schedTime(),
+        .buttons= buttonState,
+        .transitions= activeTransitions.count,
+    };
+    uint8_t sreg= SREG;
+    cli();
+    for(uint8_t i= 0; i<3; ++i)
+        report.rgb[i]= ledValues[i];
+    report.duty[0]= OCR1A;
+    report.duty[1]= OCR1B;
+    report.duty[2]= OCR3A;
+    report.top= ICR1;
+    report.frames= colorStream.frames;
+    report.crcErrors= colorStream.crcErrors;
+    report.lost= colorStream.lost;
+    report.overruns= colorStream.overruns;
+    report.packets= vendorPackets;
+    report.stallFrames= vendorStallFrames;
+    SREG= sreg;
+    vendorSend(&report);
+}
+
+#define LINE_MAX 64
+static char linebuffer[LINE_MAX+1];
+
+bool ProcessCDCListing(void)
+{
+    if(!listing)
+        return false;
+    if(serialTxFree()<SERIAL_TX_SIZE)
+        return true;
+    if(!listing(listingRow++))
+    {
+        listing= 0;
+        printf("'%s' OK\n", linebuffer);
+    }
+    return true;
+}
+
+static void cdcParse(uint8_t c)
 {
-    #define LINE_MAX 32
-    static char linebuffer[LINE_MAX+1];
     static int offset= 0;
+    static uint8_t frame[STREAM_FRAME_LEN];
+    static uint8_t frameOffset= 0;
     
-    if(c=='\n' || c=='\r')
+    if(frameOffset)
+    {
+        frame[frameOffset++]= c;
+        if(frameOffset==STREAM_FRAME_LEN)
+        {
+            frameOffset= 0;
+            if(!ProcessStreamFrame(frame))
+            {
+                // a short or corrupt frame took bytes of what followed it: parse them
+                // again, so the next sync byte or text line isn't lost with it
+                uint8_t rest[STREAM_FRAME_LEN-1];
+                memcpy(rest, frame+1, sizeof(rest));
+                for(uint8_t i= 0; i<sizeof(rest); ++i)
+                    cdcParse(rest[i]);
+            }
+        }
+    }
+    else if(c==STREAM_SYNC)
+        frame[0]= c,
+        frameOffset= 1,
+        offset= 0;      // drops a partial line
+    else if((c<' ' && c!='\t' && c!='\n' && c!='\r') || c>=0x80)
+        offset= 0;      // binary, not a command: leftovers of a frame
+    else if(c=='\n' || c=='\r')
     {
         linebuffer[offset&(LINE_MAX-1)]= 0;
         if(strlen(linebuffer))
         {
+            listingRow= 0;
             if(!ProcessCDCLine(linebuffer))
                 printf("invalid command '%s'\n", linebuffer);
-            else
+            else if(!listing)
                 printf("'%s' OK\n", linebuffer);
         }
         offset= 0;
@@ -563,3 +1807,9 @@ void ProcessCDCChar(uint8_t c)
         linebuffer[(offset++)&(LINE_MAX-1)]= c;
 }
 
+void ProcessCDCChar(uint8_t c)
+{
+    traceCdc(c);
+    cdcParse(c);
+}
+
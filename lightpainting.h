@@ -1,7 +1,16 @@
 #ifndef TOUCHPADTEST_H
 #define TOUCHPADTEST_H
 
+#include <stdint.h>
+
+// one color, both before and after the brightness curves
+struct ledFrame
+{
+    int16_t rgb[3];
+    uint16_t fine[3];
+};
+
+// adds its tasks to the scheduler, the main loop calls schedRun()
 void setup(void);
-void tick(void);
 
 #endif //TOUCHPADTEST_H
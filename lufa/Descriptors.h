@@ -41,6 +41,8 @@
 
 		#include <LUFA/Drivers/USB/USB.h>
 
+		#include "vendor.h"
+
 	/* Macros: */
 		/** Endpoint address of the CDC device-to-host notification IN endpoint. */
 		#define CDC_NOTIFICATION_EPADDR        (ENDPOINT_DIR_IN  | 2)
@@ -57,6 +59,28 @@
 		/** Size in bytes of the CDC data IN and OUT endpoints. */
 		#define CDC_TXRX_EPSIZE                16
 
+		/** Endpoint address of the vendor interface's device-to-host report IN endpoint. */
+		#define VENDOR_IN_EPADDR               (ENDPOINT_DIR_IN  | 1)
+
+		/** Endpoint address of the vendor interface's host-to-device data OUT endpoint. */
+		#define VENDOR_OUT_EPADDR              (ENDPOINT_DIR_OUT | 5)
+
+		/** Number of banks of the vendor endpoints, so the host can fill one while the other is read. */
+		#define VENDOR_BANKS                   2
+
+		/** Polling interval of the vendor endpoints in frames, i.e. milliseconds at full speed. */
+		#define VENDOR_POLLING_MS              1
+
+		/** Dual-port RAM of the ATmega32u4's USB controller, which holds the banks of all endpoints. */
+		#define USB_DPRAM_SIZE                 832
+
+		/** Largest bank of endpoints 2 to 6 on the ATmega32u4; only endpoint 1 takes up to 256 bytes. */
+		#define ENDPOINT_MAX_BANK_SIZE         64
+
+		/** Dual-port RAM the configured endpoints take, control endpoint included. */
+		#define ENDPOINT_DPRAM_USED            (FIXED_CONTROL_ENDPOINT_SIZE + CDC_NOTIFICATION_EPSIZE + \
+		                                        2 * CDC_TXRX_EPSIZE + 2 * VENDOR_BANKS * VENDOR_EPSIZE)
+
 	/* Type Defines: */
 		/** Type define for the device configuration descriptor structure. This must be defined in the
 		 *  application code, as the configuration descriptor contains several sub-descriptors which
@@ -66,6 +90,9 @@
 		{
 			USB_Descriptor_Configuration_Header_t    Config;
 
+			// CDC Interface Association, groups the two CDC interfaces into one function
+			USB_Descriptor_Interface_Association_t   CDC_IAD;
+
 			// CDC Control Interface
 			USB_Descriptor_Interface_t               CDC_CCI_Interface;
 			USB_CDC_Descriptor_FunctionalHeader_t    CDC_Functional_Header;
@@ -77,6 +104,11 @@
 			USB_Descriptor_Interface_t               CDC_DCI_Interface;
 			USB_Descriptor_Endpoint_t                CDC_DataOutEndpoint;
 			USB_Descriptor_Endpoint_t                CDC_DataInEndpoint;
+
+			// Vendor Interface
+			USB_Descriptor_Interface_t               Vendor_Interface;
+			USB_Descriptor_Endpoint_t                Vendor_DataInEndpoint;
+			USB_Descriptor_Endpoint_t                Vendor_DataOutEndpoint;
 		} USB_Descriptor_Configuration_t;
 
 		/** Enum for the device interface descriptor IDs within the device. Each interface descriptor
@@ -87,6 +119,7 @@
 		{
 			INTERFACE_ID_CDC_CCI = 0, /**< CDC CCI interface descriptor ID */
 			INTERFACE_ID_CDC_DCI = 1, /**< CDC DCI interface descriptor ID */
+			INTERFACE_ID_Vendor  = 2, /**< Vendor specific interface descriptor ID */
 		};
 
 		/** Enum for the device string descriptor IDs within the device. Each string descriptor should
@@ -98,6 +131,7 @@
 			STRING_ID_Language     = 0, /**< Supported Languages string descriptor ID (must be zero) */
 			STRING_ID_Manufacturer = 1, /**< Manufacturer string ID */
 			STRING_ID_Product      = 2, /**< Product string ID */
+			STRING_ID_Vendor       = 3, /**< Vendor interface string ID */
 		};
 
 	/* Function Prototypes: */
@@ -35,6 +35,9 @@
  */
 
 #include "main.h"
+#include "stats.h"
+#include "sched.h"
+#include "serial.h"
 
 /** LUFA CDC Class driver interface configuration and state information. This structure is
  *  passed to all CDC Class driver functions, so that multiple instances of the same class
@@ -66,11 +69,102 @@ USB_ClassInfo_CDC_Device_t VirtualSerial_CDC_Interface =
 			},
 	};
 
-/** Standard file stream for the CDC interface when set up, so that the virtual CDC COM port can be
- *  used like any regular character stream in the C APIs.
+/** Character stream for stdout, feeding the serial.c send ring that the start of frame interrupt
+ *  empties into the CDC IN endpoint.
  */
 FILE USBSerialStream;
 
+/** Set after an IN packet of full endpoint size, so that the next frame ends the transfer with a
+ *  zero length packet if there's nothing more to send.
+ */
+static bool TxPacketFull;
+
+/** Set while a start of frame pass services the endpoints with interrupts enabled. */
+static volatile bool FrameServiceActive;
+
+
+/** Hands everything received on the virtual serial port to the application, unless it is still
+ *  printing a listing.
+ */
+void CDCTask(void)
+{
+	int16_t character;
+	while(!ProcessCDCListing() && (character= serialGet())>=0)
+		ProcessCDCChar(character);
+}
+
+/** Moves the CDC data between the endpoints and the serial.c ring buffers. An OUT packet stays in
+ *  its bank, NAKing the host, until the receive ring has room for all of it.
+ */
+static void CDCService(void)
+{
+	serialFrame();
+
+	if (USB_DeviceState != DEVICE_STATE_Configured)
+	{
+		serialConnected = false;
+		return;
+	}
+	serialConnected = (VirtualSerial_CDC_Interface.State.ControlLineStates.HostToDevice & CDC_CONTROL_LINE_OUT_DTR) != 0;
+
+	Endpoint_SelectEndpoint(CDC_RX_EPADDR);
+	if (Endpoint_IsOUTReceived() && Endpoint_BytesInEndpoint() <= serialRxFree())
+	{
+		while (Endpoint_BytesInEndpoint())
+			serialRxPut(Endpoint_Read_8());
+		Endpoint_ClearOUT();
+	}
+
+	Endpoint_SelectEndpoint(CDC_TX_EPADDR);
+	if (Endpoint_IsINReady())
+	{
+		uint8_t Sent = 0;
+		int16_t Byte;
+		while (Sent < CDC_TXRX_EPSIZE && (Byte = serialTxGet()) >= 0)
+		{
+			Endpoint_Write_8(Byte);
+			Sent++;
+		}
+		if (Sent || TxPacketFull)
+			Endpoint_ClearIN();
+		TxPacketFull = (Sent == CDC_TXRX_EPSIZE);
+	}
+}
+
+/** Moves one packet each way between the vendor interface's endpoints and vendor.c. Like the CDC
+ *  OUT packets, a vendor OUT packet waits in its bank while the receive ring is full; the second bank
+ *  takes the next one meanwhile. A report is only written when there is a new one, the host gets
+ *  NAKed otherwise.
+ */
+static void VendorService(void)
+{
+	Endpoint_SelectEndpoint(VENDOR_OUT_EPADDR);
+	if (Endpoint_IsOUTReceived())
+	{
+		uint8_t* Packet = vendorRxSlot();
+		if (Packet)
+		{
+			uint8_t Length = Endpoint_BytesInEndpoint();
+			for (uint8_t i = 0; i < Length; i++)
+				Packet[i] = Endpoint_Read_8();
+			vendorRxPut(Length);
+			Endpoint_ClearOUT();
+		}
+	}
+
+	Endpoint_SelectEndpoint(VENDOR_IN_EPADDR);
+	if (Endpoint_IsINReady())
+	{
+		const struct vendorReport* Report = vendorTxGet();
+		if (Report)
+		{
+			const uint8_t* Data = (const uint8_t*)Report;
+			for (uint8_t i = 0; i < sizeof(*Report); i++)
+				Endpoint_Write_8(Data[i]);
+			Endpoint_ClearIN();
+		}
+	}
+}
 
 /** Main program entry point. This routine contains the overall program flow, including initial
  *  setup of all components and the main program loop.
@@ -79,24 +173,21 @@ int main(void)
 {
 	SetupHardware();
 
-	/* Create a regular character stream for the interface so that it can be used with the stdio.h functions */
-	CDC_Device_CreateStream(&VirtualSerial_CDC_Interface, &USBSerialStream);
+	/* Create a regular character stream on the send ring so that it can be used with the stdio.h functions */
+	fdev_setup_stream(&USBSerialStream, serialPutChar, NULL, _FDEV_SETUP_WRITE);
     
     stdout= &USBSerialStream;
 
+	/* The USB interrupts service the device; the main loop only interprets what was received */
+	schedAdd(PSTR("cdc"), CDCTask, SCHED_MS(1));
     setup();
 
 	GlobalInterruptEnable();
 
 	for (;;)
 	{
-		/* Must throw away unused bytes from the host, or it will lock up while waiting for the device */
-		int16_t character= CDC_Device_ReceiveByte(&VirtualSerial_CDC_Interface);
-		if(character>=0) ProcessCDCChar(character);
-
-		CDC_Device_USBTask(&VirtualSerial_CDC_Interface);
-		USB_USBTask();
-        tick();
+		schedRun();
+		schedSleep();
 	}
 }
 
@@ -166,6 +257,7 @@ void EVENT_USB_Device_Connect(void)
 /** Event handler for the library USB Disconnection event. */
 void EVENT_USB_Device_Disconnect(void)
 {
+	serialConnected = false;
 }
 
 /** Event handler for the library USB Configuration Changed event. */
@@ -173,7 +265,60 @@ void EVENT_USB_Device_ConfigurationChanged(void)
 {
 	bool ConfigSuccess = true;
 
+	/* In ascending endpoint order (1, 2-4, 5): the controller allocates the DPRAM in that order, so no
+	 * endpoint has to be moved for one configured after it with a lower number */
+	ConfigSuccess &= Endpoint_ConfigureEndpoint(VENDOR_IN_EPADDR, EP_TYPE_INTERRUPT, VENDOR_EPSIZE, VENDOR_BANKS);
 	ConfigSuccess &= CDC_Device_ConfigureEndpoints(&VirtualSerial_CDC_Interface);
+	ConfigSuccess &= Endpoint_ConfigureEndpoint(VENDOR_OUT_EPADDR, EP_TYPE_INTERRUPT, VENDOR_EPSIZE, VENDOR_BANKS);
+	TxPacketFull = false;
+
+	/* A start of frame pass re-enables them itself when it ends */
+	if (!FrameServiceActive)
+		USB_Device_EnableSOFEvents();
+}
+
+/** Event handler for the USB start of frame, once per millisecond from the USB general interrupt.
+ *  Control requests are handled by the USB_COM interrupt (INTERRUPT_CONTROL_ENDPOINT in LUFAConfig.h),
+ *  so neither depends on the main loop. The CDC and vendor service runs with interrupts enabled, so
+ *  the ADB and Timer1 interrupts aren't held up by it, but with all other USB interrupts masked: bus
+ *  resets, suspend and VBUS events wait in USB_GEN, control requests in USB_COM, until the pass has
+ *  left the endpoints alone, and the SOF interrupt can't nest into itself. A control request being
+ *  handled also runs with interrupts enabled and may be resetting or reconfiguring the endpoints;
+ *  a frame arriving meanwhile is skipped.
+ */
+void EVENT_USB_Device_StartOfFrame(void)
+{
+	uint8_t PrevEndpoint = Endpoint_GetCurrentEndpoint();
+
+	Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+	if (!(UEIENX & (1 << RXSTPE)))
+	{
+		Endpoint_SelectEndpoint(PrevEndpoint);
+		return;
+	}
+	UEIENX &= ~(1 << RXSTPE);
+	Endpoint_SelectEndpoint(PrevEndpoint);
+
+	uint8_t DeviceInterrupts = UDIEN;
+	uint8_t VBUSInterrupt = USBCON & (1 << VBUSTE);
+	UDIEN = 0;
+	USBCON &= ~(1 << VBUSTE);
+	FrameServiceActive = true;
+
+	GlobalInterruptEnable();
+	STATS_BEGIN(STATS_USB_FRAME);
+	CDCService();
+	if (USB_DeviceState == DEVICE_STATE_Configured)
+		VendorService();
+	STATS_END(STATS_USB_FRAME);
+	GlobalInterruptDisable();
+
+	FrameServiceActive = false;
+	USBCON |= VBUSInterrupt;
+	UDIEN = DeviceInterrupts;
+	Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+	UEIENX |= (1 << RXSTPE);
+	Endpoint_SelectEndpoint(PrevEndpoint);
 }
 
 /** Event handler for the library USB Control Request reception event. */
@@ -65,11 +65,14 @@
 
 	/* Function Prototypes: */
 		void SetupHardware(void);
+		void CDCTask(void);
 
 		void EVENT_USB_Device_Connect(void);
 		void EVENT_USB_Device_Disconnect(void);
 		void EVENT_USB_Device_ConfigurationChanged(void);
 		void EVENT_USB_Device_ControlRequest(void);
+		void EVENT_USB_Device_StartOfFrame(void);
 		void ProcessCDCChar(uint8_t c);
+		bool ProcessCDCListing(void);
 #endif
 
@@ -0,0 +1,76 @@
+#include <stdlib.h>
+#include "motion.h"
+
+#define MOTION_MAX_SPEED    30000   // units/s
+
+// smoothing factor for a cutoff (Hz*256) at a sample interval (ms), 1.15 fixed point.
+// alpha= 1/(1+tau/dt), tau= 1/(2 pi fc)  ->  r/(r+1000*256) with r= 2 pi dt fc
+static uint16_t motionAlpha(uint16_t cutoff, uint8_t dt)
+{
+    uint32_t r= (uint32_t)dt*cutoff*201 >> 5;      // 201/32 ~ 2 pi
+    return (r << 8) / ((r + 256000UL) >> 7);
+}
+
+void motionReset(struct motionFilter *f)
+{
+    f->valid= 0;
+}
+
+static int16_t motionAxisUpdate(struct motionAxis *a, const struct motionParams *p, uint16_t in, uint8_t dt)
+{
+    int32_t raw= (int32_t)in << MOTION_FRAC;
+    
+    // speed, low passed at a fixed cutoff
+    int32_t rawdx= (raw - a->x) * 1000 / dt >> MOTION_FRAC;
+    if(rawdx>MOTION_MAX_SPEED) rawdx= MOTION_MAX_SPEED;
+    if(rawdx<-MOTION_MAX_SPEED) rawdx= -MOTION_MAX_SPEED;
+    uint16_t dCutoff= p->dCutoff<MOTION_MAX_CUTOFF? p->dCutoff: MOTION_MAX_CUTOFF;
+    a->dx+= (rawdx - a->dx) * motionAlpha(dCutoff, dt) >> 15;
+    
+    // position, low passed at a cutoff that rises with the speed
+    uint16_t speed= labs(a->dx);
+    uint32_t cutoff= p->minCutoff + ((uint32_t)speed*p->beta >> 8);
+    if(cutoff>MOTION_MAX_CUTOFF)
+        cutoff= MOTION_MAX_CUTOFF;
+    int32_t last= a->x;
+    a->x+= (raw - a->x) * motionAlpha(cutoff, dt) >> 15;
+    
+    // acceleration
+    uint8_t gain;
+    if(speed<=p->accelLowSpeed)
+        gain= p->accelLowGain;
+    else if(speed>=p->accelHighSpeed)
+        gain= p->accelHighGain;
+    else
+        gain= p->accelLowGain + (int32_t)(p->accelHighGain-p->accelLowGain) * 
+                (speed-p->accelLowSpeed) / (p->accelHighSpeed-p->accelLowSpeed);
+    int32_t moved= ((a->x - last) * gain >> 4) + a->carry;
+    a->carry= moved & ((1<<MOTION_FRAC)-1);
+    return moved >> MOTION_FRAC;
+}
+
+void motionUpdate(struct motionFilter *f, const struct motionParams *p, 
+                  uint16_t x, uint16_t y, uint16_t time, int16_t *rel)
+{
+    uint16_t dt= time - f->time;
+    f->time= time;
+    if(!f->valid || dt>MOTION_MAX_DT)
+    {
+        for(uint8_t i= 0; i<2; ++i)
+            f->axis[i].x= (int32_t)(i? y: x) << MOTION_FRAC,
+            f->axis[i].dx= 0,
+            f->axis[i].carry= 0;
+        f->valid= 1;
+        rel[0]= rel[1]= 0;
+        return;
+    }
+    if(!dt)
+        dt= 1;
+    rel[0]= motionAxisUpdate(&f->axis[0], p, x, dt);
+    rel[1]= motionAxisUpdate(&f->axis[1], p, y, dt);
+}
+
+uint16_t motionPosition(const struct motionFilter *f, uint8_t axis)
+{
+    return f->axis[axis].x >> MOTION_FRAC;
+}
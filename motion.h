@@ -0,0 +1,46 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+// touchpad motion filter between the ADB decode and dragAction().
+// a 1-euro filter (adaptive low pass: the faster the finger, the higher the cutoff,
+// so resting is smooth and sweeping doesn't lag) followed by an acceleration curve
+// on the filtered deltas. all fixed point, one 32-bit division per axis and sample.
+
+#include <stdint.h>
+
+#define MOTION_FRAC         3       // fractional bits of the filtered positions
+#define MOTION_MAX_DT       64      // ms, longer gaps restart the filter
+#define MOTION_MAX_CUTOFF   (64*256) // Hz*256, higher ones overflow the alpha at MOTION_MAX_DT
+
+struct motionParams
+{
+    uint16_t minCutoff;             // Hz*256 at rest
+    uint16_t beta;                  // Hz*256 more per 256 units/s
+    uint16_t dCutoff;               // Hz*256 for the speed estimate
+    uint16_t accelLowSpeed;         // units/s, below this the low gain applies
+    uint16_t accelHighSpeed;        // units/s, above this the high gain applies
+    uint8_t accelLowGain;           // 1/16, linear in between
+    uint8_t accelHighGain;
+};
+
+struct motionAxis
+{
+    int32_t x;                      // filtered position << MOTION_FRAC
+    int32_t dx;                     // filtered speed, units/s
+    int16_t carry;                  // accelerated movement not reported yet << MOTION_FRAC
+};
+
+struct motionFilter
+{
+    struct motionAxis axis[2];
+    uint16_t time;                  // of the last sample, ms
+    uint8_t valid;
+};
+
+void motionReset(struct motionFilter *f);
+// feed a raw sample taken at 'time' (ms), get the accelerated movement since the last one
+void motionUpdate(struct motionFilter *f, const struct motionParams *p, 
+                  uint16_t x, uint16_t y, uint16_t time, int16_t *rel);
+uint16_t motionPosition(const struct motionFilter *f, uint8_t axis);
+
+#endif //MOTION_H
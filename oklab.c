@@ -0,0 +1,249 @@
+#include <avr/pgmspace.h>
+#include "oklab.h"
+
+#define CLAMP(V, min, max) do { if(V<min) V= min; if(V>max) V= max; } while(0)
+#define LERP(a, b, t)       ((a) + (int16_t)((((int32_t)(b)-(a))*(t)) >> OKLAB_LERP_BITS))
+// fixed-point constant with 'bits' fraction bits
+#define Q(x, bits)          ((int32_t)((x)*(1L<<(bits)) + ((x)<0? -0.5: 0.5)))
+
+// OKLab's matrices for linear sRGB primaries, the LEDs' are close enough and
+// calibration.c corrects the rest. Q14 where the entries are below 1, else Q12
+static const int16_t rgbToLms[3][3] PROGMEM=
+{
+    { Q(0.4122214708, 14), Q(0.5363325363, 14), Q(0.0514459929, 14) },
+    { Q(0.2119034982, 14), Q(0.6806995451, 14), Q(0.1073969566, 14) },
+    { Q(0.0883024619, 14), Q(0.2817188376, 14), Q(0.6299787005, 14) },
+};
+static const int16_t lmsToLab[3][3] PROGMEM=
+{
+    { Q(0.2104542553, 12), Q(0.7936177850, 12), Q(-0.0040720468, 12) },
+    { Q(1.9779984951, 12), Q(-2.4285922050, 12), Q(0.4505937099, 12) },
+    { Q(0.0259040371, 12), Q(0.7827717662, 12), Q(-0.8086757660, 12) },
+};
+static const int16_t labToLms[3][3] PROGMEM=
+{
+    { Q(1.0, 12), Q(0.3963377774, 12), Q(0.2158037573, 12) },
+    { Q(1.0, 12), Q(-0.1055613458, 12), Q(-0.0638541728, 12) },
+    { Q(1.0, 12), Q(-0.0894841775, 12), Q(-1.2914855480, 12) },
+};
+static const int16_t lmsToRgb[3][3] PROGMEM=
+{
+    { Q(4.0767416621, 12), Q(-3.3077115913, 12), Q(0.2309699292, 12) },
+    { Q(-1.2684380046, 12), Q(2.6097574011, 12), Q(-0.3413193965, 12) },
+    { Q(-0.0041960863, 12), Q(-0.7034186147, 12), Q(1.7076147010, 12) },
+};
+
+// the tables have 64 segments, interpolated linearly. computed by the compiler
+// like the brightness curves
+#define TABLE_X(i)          ((i)/64.0)
+#define TABLE_ROW(F, i)     F(i), F(i+1), F(i+2), F(i+3), F(i+4), F(i+5), F(i+6), F(i+7)
+#define TABLE_ROWS(F, i)    TABLE_ROW(F, i), TABLE_ROW(F, i+8), TABLE_ROW(F, i+16), TABLE_ROW(F, i+24)
+
+// cube roots of 1/8..1; smaller values are scaled up by 8s first, which
+// doubles the root, so the steep part near 0 never needs a table
+#define CBRT_FIRST          8
+#define CBRT_AT(i)          (uint16_t)(__builtin_cbrt(TABLE_X(i))*OKLAB_ONE+0.5)
+static const uint16_t cbrtTable[64-CBRT_FIRST+1] PROGMEM=
+{
+    TABLE_ROW(CBRT_AT, 8), TABLE_ROWS(CBRT_AT, 16), TABLE_ROW(CBRT_AT, 48), TABLE_ROW(CBRT_AT, 56), CBRT_AT(64)
+};
+
+// angles are in 1/65536 turns. atan of 0..1, i.e. 0..1/8 turn
+#define ATAN_AT(i)          (uint16_t)(__builtin_atan(TABLE_X(i))*(65536/(2*3.14159265358979))+0.5)
+static const uint16_t atanTable[65] PROGMEM=
+{
+    TABLE_ROWS(ATAN_AT, 0), TABLE_ROWS(ATAN_AT, 32), ATAN_AT(64)
+};
+
+// sine of the first quarter turn
+#define SINE_AT(i)          (uint16_t)(__builtin_sin(TABLE_X(i)*(3.14159265358979/2))*OKLAB_ONE+0.5)
+static const uint16_t sineTable[65] PROGMEM=
+{
+    TABLE_ROWS(SINE_AT, 0), TABLE_ROWS(SINE_AT, 32), SINE_AT(64)
+};
+
+// chroma below this takes its hue from the other side, about 0.01
+#define OKLAB_GRAY          164
+
+// x is 0..0x3FFF, 'table' holds segments of 256 from 0
+static uint16_t tableLookup(const uint16_t *table, uint16_t x)
+{
+    uint8_t i= x>>8;
+    uint16_t y0= pgm_read_word(&table[i]);
+    if(!(x&0xFF))
+        return y0;
+    uint16_t y1= pgm_read_word(&table[i+1]);
+    return y0 + (int16_t)(((int32_t)(y1-y0)*(x&0xFF)) >> 8);
+}
+
+// m times the column in, rounded to 'bits' less fraction bits. 'in' holds
+// int16_t if 'sign', else luminances, which use all 16 bits. both products
+// stay 16x16 bit multiplies
+static void transform(const int16_t m[3][3], uint8_t bits, const uint16_t *in, bool sign, int32_t *out)
+{
+    for(uint8_t i= 0; i<3; ++i)
+    {
+        int32_t x= 0;
+        for(uint8_t k= 0; k<3; ++k)
+        {
+            int16_t c= pgm_read_word(&m[i][k]);
+            x+= sign? (int32_t)c*(int16_t)in[k]: (int32_t)c*in[k];
+        }
+        out[i]= (x + (1L<<(bits-1))) >> bits;
+    }
+}
+
+// luminances are 0..0xFFFF for 0..1, the dark end needs the resolution.
+// x in that range, the root in 0..OKLAB_ONE
+static uint16_t cubeRoot(uint16_t x)
+{
+    uint8_t k= 0;
+    if(!x)
+        return 0;
+    while(x<CBRT_FIRST<<10)
+        x<<= 3, k++;
+    return tableLookup(cbrtTable, (x-(CBRT_FIRST<<10))>>2) >> k;
+}
+
+// x in 0..OKLAB_ONE, outside clamped; the cube is a luminance
+static uint16_t cube(int32_t x)
+{
+    CLAMP(x, 0, OKLAB_ONE);
+    uint32_t y= (((uint32_t)x*x >> OKLAB_BITS)*x) >> (2*OKLAB_BITS-16);
+    return y>0xFFFF? 0xFFFF: y;
+}
+
+// the CIE L* curve: RGB value in 0..OKLAB_RGB_MAX to luminance
+static uint16_t linearize(uint16_t x)
+{
+    if(x<=Q(0.08, 14))
+        return ((uint32_t)x*Q(4*100/903.3, 14)) >> 14;
+    uint32_t t= (((uint32_t)x*Q(100/116.0, 12)) >> 12) + Q(16/116.0, 14);
+    return (((t*t) >> 14)*t) >> 12;
+}
+
+// and back
+static uint16_t delinearize(uint16_t y)
+{
+    uint32_t x;
+    if(y<=Q(0.008856, 16))
+        x= ((uint32_t)y*Q(9.033/4, 12)) >> 12;
+    else
+        x= (((uint32_t)cubeRoot(y)*Q(1.16, 12)) >> 12) - Q(0.16, 14);
+    return x>OKLAB_RGB_MAX? OKLAB_RGB_MAX: x;
+}
+
+// atan2(y, x) in 1/65536 turns
+static uint16_t angle(int16_t y, int16_t x)
+{
+    uint16_t ax= x<0? -x: x, ay= y<0? -y: y, a;
+    if(!ax && !ay)
+        return 0;
+    if(ay<=ax)
+        a= tableLookup(atanTable, ((uint32_t)ay<<OKLAB_BITS)/ax);
+    else
+        a= 0x4000 - tableLookup(atanTable, ((uint32_t)ax<<OKLAB_BITS)/ay);
+    if(x<0)
+        a= 0x8000 - a;
+    return y<0? -a: a;
+}
+
+static int16_t sine(uint16_t a)
+{
+    uint16_t x= a & 0x3FFF;
+    if(a & 0x4000)
+        x= 0x4000 - x;
+    int16_t s= tableLookup(sineTable, x);
+    return a & 0x8000? -s: s;
+}
+
+static uint16_t squareRoot(uint32_t v)
+{
+    uint32_t root= 0, bit= 1UL<<30;
+    while(bit>v)
+        bit>>= 2;
+    while(bit)
+    {
+        if(v>=root+bit)
+            v-= root+bit, root= (root>>1) + bit;
+        else
+            root>>= 1;
+        bit>>= 2;
+    }
+    return root;
+}
+
+void oklabFromRgb(const uint16_t *rgb, int16_t *lab)
+{
+    uint16_t linear[3], root[3];
+    int32_t v[3];
+    for(uint8_t i= 0; i<3; ++i)
+        linear[i]= linearize(rgb[i]>OKLAB_RGB_MAX? OKLAB_RGB_MAX: rgb[i]);
+    transform(rgbToLms, 14, linear, false, v);
+    for(uint8_t i= 0; i<3; ++i)
+    {
+        CLAMP(v[i], 0, 0xFFFF);
+        root[i]= cubeRoot(v[i]);
+    }
+    transform(lmsToLab, 12, root, false, v);
+    for(uint8_t i= 0; i<3; ++i)
+        lab[i]= v[i];
+}
+
+void oklabToRgb(const int16_t *lab, uint16_t *rgb)
+{
+    uint16_t lms[3];
+    int32_t v[3];
+    transform(labToLms, 12, (const uint16_t *)lab, true, v);
+    for(uint8_t i= 0; i<3; ++i)
+        lms[i]= cube(v[i]);
+    transform(lmsToRgb, 12, lms, false, v);
+    // outside the gamut: move towards the gray of the same L until all channels
+    // fit, that keeps the lightness where clipping each channel would not
+    int32_t gray= cube(lab[0]);
+    int32_t keep= 1L<<16;
+    for(uint8_t i= 0; i<3; ++i)
+    {
+        int32_t k= keep;
+        if(v[i]>0xFFFF)
+            k= ((uint32_t)(0xFFFF-gray)<<16)/(uint32_t)(v[i]-gray);
+        else if(v[i]<0)
+            k= ((uint32_t)gray<<16)/(uint32_t)(gray-v[i]);
+        if(k<keep)
+            keep= k;
+    }
+    for(uint8_t i= 0; i<3; ++i)
+    {
+        if(keep!=1L<<16)
+        {
+            // (v-gray)*keep >> 16 in 32 bits, the distance takes up to 19 of them
+            int32_t d= v[i]-gray;
+            v[i]= gray + (d>>16)*keep + (((uint32_t)(d & 0xFFFF)*keep) >> 16);
+        }
+        CLAMP(v[i], 0, 0xFFFF);
+        rgb[i]= delinearize(v[i]);
+    }
+}
+
+void oklabLerp(const int16_t *a, const int16_t *b, uint16_t offset, bool polar, int16_t *lab)
+{
+    if(!polar)
+    {
+        for(uint8_t i= 0; i<3; ++i)
+            lab[i]= LERP(a[i], b[i], offset);
+        return;
+    }
+    uint16_t ca= squareRoot((int32_t)a[1]*a[1] + (int32_t)a[2]*a[2]),
+             cb= squareRoot((int32_t)b[1]*b[1] + (int32_t)b[2]*b[2]);
+    uint16_t ha= angle(a[2], a[1]), hb= angle(b[2], b[1]);
+    if(ca<OKLAB_GRAY)
+        ha= hb;
+    if(cb<OKLAB_GRAY)
+        hb= ha;
+    // the short way around
+    uint16_t h= ha + (int16_t)(((int32_t)(int16_t)(hb-ha)*offset) >> OKLAB_LERP_BITS);
+    int16_t c= LERP((int16_t)ca, (int16_t)cb, offset);
+    lab[0]= LERP(a[0], b[0], offset);
+    lab[1]= ((int32_t)c*sine(h+0x4000)) >> OKLAB_BITS;
+    lab[2]= ((int32_t)c*sine(h)) >> OKLAB_BITS;
+}
@@ -0,0 +1,32 @@
+#ifndef OKLAB_H
+#define OKLAB_H
+
+// fixed-point OKLab (Björn Ottosson, 2020) for transitions that keep their
+// lightness: a straight line in OKLab between two colors changes the
+// perceived lightness evenly and doesn't dip into the dark, muddy mixes a
+// walk through HSV or RGB takes. OKLCh is the same space in polar form, the
+// hue goes around the short way and the chroma stays up.
+//
+// the RGB side is the one hsv2rgb() produces, before calibration and the
+// curves. it counts as CIE L* encoded, the default curve, and is linearized
+// with that before the OKLab matrices. the cube roots and the angles come
+// from small PROGMEM tables, everything else is 16x16 bit multiplies.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define OKLAB_BITS          14
+#define OKLAB_ONE           (1<<OKLAB_BITS)     // L of white; a, b are about -0.4..0.4
+#define OKLAB_RGB_MAX       ((1<<14)-1)         // RGB_MAX in lightpainting.c
+#define OKLAB_LERP_BITS     15                  // TRANSITION_BITS in lightpainting.c
+
+// rgb in 0..OKLAB_RGB_MAX to L, a, b
+void oklabFromRgb(const uint16_t *rgb, int16_t *lab);
+// back. colors outside the RGB gamut lose chroma at the same L until they fit
+void oklabToRgb(const int16_t *lab, uint16_t *rgb);
+// 'offset' of the way from a to b, 0..1<<OKLAB_LERP_BITS. polar blends
+// lightness, chroma and hue (OKLCh); if one side is gray it takes the
+// other's hue
+void oklabLerp(const int16_t *a, const int16_t *b, uint16_t offset, bool polar, int16_t *lab);
+
+#endif //OKLAB_H
@@ -0,0 +1,104 @@
+#ifndef PERSIST_H
+#define PERSIST_H
+
+// wear leveled record store in the EEPROM.
+// the area is split into PERSIST_SLOTS slots of PERSIST_SLOT_SIZE bytes, each commit
+// goes to the slot after the newest one. a slot holds
+//  version, sequence number, payload, CRC-16 of all that
+// and the newest slot with the right version and a good CRC wins on load.
+// writes are spread over many calls of persistWriteStep(), one byte whenever
+// the EEPROM is ready, so the main loop never waits the 3.4 ms per byte.
+
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+#if(!defined(PERSIST_BASE) || !defined(PERSIST_SLOT_SIZE) || !defined(PERSIST_SLOTS) || !defined(PERSIST_VERSION))
+#error "need to #define necessary stuff before including this"
+#endif
+
+#define PERSIST_HEADER  2       // version, sequence
+#define PERSIST_CRC     2
+#define PERSIST_PAYLOAD (PERSIST_SLOT_SIZE-PERSIST_HEADER-PERSIST_CRC)
+
+CASSERT(PERSIST_SLOT_SIZE*PERSIST_SLOTS<=E2END+1, persistSize);
+CASSERT(PERSIST_SLOTS<128, persistSlots);
+
+struct
+{
+    uint8_t slot;                       // newest slot, PERSIST_SLOTS if none
+    uint8_t sequence;
+    uint8_t buffer[PERSIST_SLOT_SIZE];  // record being written
+    uint8_t length;                     // bytes of buffer to write
+    uint8_t written;                    // bytes written so far
+} persist= { PERSIST_SLOTS };
+
+static uint8_t *persistSlotAddr(uint8_t slot)
+{
+    return (uint8_t *)(uintptr_t)(PERSIST_BASE + (uint16_t)slot*PERSIST_SLOT_SIZE);
+}
+
+static uint16_t persistSlotCRC(uint8_t slot, uint8_t size)
+{
+    uint16_t crc= 0xFFFF;
+    uint8_t *addr= persistSlotAddr(slot);
+    for(uint8_t i= 0; i<PERSIST_HEADER+size; ++i)
+        crc= _crc16_update(crc, eeprom_read_byte(addr+i));
+    return crc;
+}
+
+// find the newest valid record and copy its payload to 'record'.
+// returns false if there is none.
+bool persistLoad(void *record, uint8_t size)
+{
+    persist.slot= PERSIST_SLOTS;
+    for(uint8_t slot= 0; slot<PERSIST_SLOTS; ++slot)
+    {
+        uint8_t *addr= persistSlotAddr(slot);
+        if(eeprom_read_byte(addr)!=PERSIST_VERSION)
+            continue;
+        if(persistSlotCRC(slot, size)!=eeprom_read_word((uint16_t *)(addr+PERSIST_HEADER+size)))
+            continue;
+        uint8_t sequence= eeprom_read_byte(addr+1);
+        if(persist.slot==PERSIST_SLOTS || (int8_t)(sequence-persist.sequence)>0)
+            persist.slot= slot,
+            persist.sequence= sequence;
+    }
+    if(persist.slot==PERSIST_SLOTS)
+        return false;
+    eeprom_read_block(record, persistSlotAddr(persist.slot)+PERSIST_HEADER, size);
+    return true;
+}
+
+// snapshot 'record' and start writing it to the next slot
+void persistBeginWrite(const void *record, uint8_t size)
+{
+    uint16_t crc= 0xFFFF;
+    persist.buffer[0]= PERSIST_VERSION;
+    persist.buffer[1]= ++persist.sequence;
+    memcpy(persist.buffer+PERSIST_HEADER, record, size);
+    for(uint8_t i= 0; i<PERSIST_HEADER+size; ++i)
+        crc= _crc16_update(crc, persist.buffer[i]);
+    persist.buffer[PERSIST_HEADER+size]= crc;
+    persist.buffer[PERSIST_HEADER+size+1]= crc>>8;
+    persist.length= PERSIST_HEADER+size+PERSIST_CRC;
+    persist.written= 0;
+    persist.slot= persist.slot+1<PERSIST_SLOTS? persist.slot+1: 0;
+}
+
+bool persistBusy(void)
+{
+    return persist.written<persist.length;
+}
+
+// write the next byte if the EEPROM is ready. the version byte goes last, so an
+// erased slot doesn't look valid before the record is complete; a reused one fails the CRC.
+void persistWriteStep(void)
+{
+    if(!persistBusy() || !eeprom_is_ready())
+        return;
+    uint8_t i= persist.written+1<persist.length? persist.written+1: 0;
+    eeprom_update_byte(persistSlotAddr(persist.slot)+i, persist.buffer[i]);
+    persist.written++;
+}
+
+#endif //PERSIST_H
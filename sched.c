@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include "sched.h"
+#include "stats.h"
+
+volatile uint16_t schedNow;
+
+static struct schedTask tasks[SCHED_MAX_TASKS];
+static uint8_t ntasks;
+
+// sleep accounting since the last schedReset()
+static struct
+{
+    uint32_t elapsed;           // ticks
+    uint32_t sleepTicks;
+    uint16_t sleepCycles;       // below one tick
+    uint16_t lastNow;
+} power;
+
+uint16_t schedTime(void)
+{
+    uint8_t sreg= SREG;
+    cli();
+    uint16_t now= schedNow;
+    SREG= sreg;
+    return now;
+}
+
+// returns the task's index, -1 if the table is full
+int8_t schedAdd(const char *name, void (*run)(void), uint16_t period)
+{
+    if(ntasks==SCHED_MAX_TASKS)
+        return -1;
+    struct schedTask *t= &tasks[ntasks];
+    memset(t, 0, sizeof(*t));
+    t->name= name;
+    t->run= run;
+    t->period= period;
+    t->next= schedTime();
+    return ntasks++;
+}
+
+void schedRun(void)
+{
+    STATS_BEGIN(STATS_SCHED);
+    for(uint8_t i= 0; i<ntasks; ++i)
+    {
+        struct schedTask *t= &tasks[i];
+        uint16_t now= schedTime();
+        if(t->period)
+        {
+            uint16_t late= now - t->next;
+            if((int16_t)late<0)
+                continue;
+            if(late>t->maxLate)
+                t->maxLate= late;
+            if(late>=t->period)
+                t->overruns+= late/t->period,
+                t->next= now;
+            t->next+= t->period;
+        }
+        t->runs++;
+        t->run();
+    }
+    STATS_END(STATS_SCHED);
+}
+
+// change a task's period. it's due again 'period' ticks from now, or right away
+// if the new period is shorter than the old one
+void schedSetPeriod(int8_t id, uint16_t period)
+{
+    struct schedTask *t= &tasks[id];
+    t->next= schedTime();
+    if(period>=t->period)
+        t->next+= period;
+    t->period= period;
+}
+
+// idle sleep until the next interrupt if no task is due. the Timer1 overflow that
+// advances schedNow wakes the CPU at least once per tick; USB, ADB and button
+// interrupts wake it too. the cycles slept are taken from TCNT1, including the
+// ISR that ended the sleep, so the duty is an estimate on the sleepy side.
+void schedSleep(void)
+{
+    uint16_t now= schedTime();
+    power.elapsed+= (uint16_t)(now - power.lastNow);
+    power.lastNow= now;
+    
+    cli();
+    for(uint8_t i= 0; i<ntasks; ++i)
+    {
+        if(!tasks[i].period || (int16_t)(schedNow - tasks[i].next)>=0)
+        {
+            sei();
+            return;
+        }
+    }
+    uint16_t top= ICR1;
+    uint16_t before= TCNT1;
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    sei();                      // the instruction after sei() runs before any interrupt
+    sleep_cpu();
+    sleep_disable();
+    uint16_t after= TCNT1;
+    
+    power.sleepCycles+= after>=before? after-before: after+top+1-before;
+    while(power.sleepCycles>=(uint16_t)(F_CPU/1000000*SCHED_TICK_US))
+        power.sleepCycles-= F_CPU/1000000*SCHED_TICK_US,
+        power.sleepTicks++;
+}
+
+void schedReset(void)
+{
+    for(uint8_t i= 0; i<ntasks; ++i)
+        tasks[i].maxLate= tasks[i].overruns= tasks[i].runs= 0;
+    power.elapsed= power.sleepTicks= power.sleepCycles= 0;
+    power.lastNow= schedTime();
+}
+
+// time since the last reset and how much of it the CPU slept
+void schedPrintPower(void)
+{
+    uint32_t elapsed= power.elapsed;
+    uint16_t permille= !elapsed? 0: elapsed<4000000? power.sleepTicks*1000/elapsed: power.sleepTicks/(elapsed/1000);
+    uint32_t ms= elapsed/1000*SCHED_TICK_US + elapsed%1000*SCHED_TICK_US/1000;  // elapsed*SCHED_TICK_US wraps after ~72 min
+    printf_P(PSTR("%lu ms, active %u.%u%%, sleep %u.%u%%\n"), (unsigned long)ms,
+             (1000-permille)/10, (1000-permille)%10, permille/10, permille%10);
+}
+
+// one line per task: name, period, runs, max lateness and overruns since the last reset
+bool schedPrint(uint8_t row)
+{
+    if(row>=ntasks)
+        return false;
+    char name[16];
+    strncpy_P(name, tasks[row].name, sizeof(name)-1);
+    name[sizeof(name)-1]= 0;
+    printf_P(PSTR("%-12s %4u %8lu %4u %4u\n"), name, tasks[row].period, (unsigned long)tasks[row].runs,
+             tasks[row].maxLate, tasks[row].overruns);
+    return true;
+}
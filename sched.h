@@ -0,0 +1,47 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+// cooperative fixed rate scheduler for the main loop.
+// the Timer1 ISR counts schedNow up once per PWM_PERIOD_US; schedRun() runs every
+// task whose release time has come, in the order they were added. a task is due
+// again 'period' ticks after its last release. if it starts a whole period or more
+// late, the missed releases count as overruns and it's rescheduled from now.
+// period 0 tasks run on every pass. between passes schedSleep() puts the CPU into
+// idle sleep when nothing is due.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#define SCHED_TICK_US       1024    // Timer1 period work, PWM_PERIOD_US
+#define SCHED_MS(ms)        ((uint16_t)(((ms)*1000UL+SCHED_TICK_US-1)/SCHED_TICK_US))
+#define SCHED_MAX_TASKS     8
+
+struct schedTask
+{
+    const char *name;       // in flash
+    void (*run)(void);
+    uint16_t period;        // ticks
+    uint16_t next;          // release time
+    uint16_t maxLate;       // ticks between release and start
+    uint16_t overruns;      // releases missed
+    uint32_t runs;
+};
+
+extern volatile uint16_t schedNow;
+
+// in the Timer1 ISR, once per SCHED_TICK_US. it runs with interrupts enabled, the
+// increment mustn't be split by the ADB and button ISRs that read schedNow
+#define SCHED_TICK()        do { uint8_t sreg= SREG; cli(); schedNow++; SREG= sreg; } while(0)
+
+uint16_t schedTime(void);        // schedNow, read atomically
+int8_t schedAdd(const char *name, void (*run)(void), uint16_t period);
+void schedSetPeriod(int8_t id, uint16_t period);
+void schedRun(void);
+void schedSleep(void);
+void schedReset(void);
+bool schedPrint(uint8_t row);     // a listing row, false past the last
+void schedPrintPower(void);
+
+#endif //SCHED_H
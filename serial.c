@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <avr/io.h>
+#include "serial.h"
+#include "stats.h"
+
+// indices run freely and wrap at 256, the difference is the fill level
+struct ring
+{
+    volatile uint8_t head, tail;
+};
+
+static struct ring rx, tx;
+static uint8_t rxBuffer[SERIAL_RX_SIZE];
+static uint8_t txBuffer[SERIAL_TX_SIZE];
+
+volatile uint8_t serialConnected;
+volatile uint16_t serialTxDropped;
+
+static inline uint8_t ringUsed(const struct ring *r)
+{
+    return r->head - r->tail;
+}
+
+uint8_t serialRxFree(void)
+{
+    return SERIAL_RX_SIZE - ringUsed(&rx);
+}
+
+void serialRxPut(uint8_t c)
+{
+    rxBuffer[rx.head & (SERIAL_RX_SIZE-1)]= c;
+    rx.head++;
+}
+
+int16_t serialGet(void)
+{
+    if(!ringUsed(&rx))
+        return -1;
+    uint8_t c= rxBuffer[rx.tail & (SERIAL_RX_SIZE-1)];
+    rx.tail++;
+    return c;
+}
+
+uint8_t serialIdle(void)
+{
+    return !ringUsed(&rx) && !ringUsed(&tx);
+}
+
+int16_t serialTxGet(void)
+{
+    if(!ringUsed(&tx))
+        return -1;
+    uint8_t c= txBuffer[tx.tail & (SERIAL_TX_SIZE-1)];
+    tx.tail++;
+    return c;
+}
+
+uint8_t serialTxFree(void)
+{
+    return SERIAL_TX_SIZE - ringUsed(&tx);
+}
+
+// the stream's put function, the platform glue sets up serialStream with it.
+// never waits for the host: waiting would hold up every task and the ADB polls,
+// so with a full ring the byte is dropped and counted. output longer than the
+// ring has to be paced by the caller with serialTxFree()
+int serialPutChar(char c, FILE *stream)
+{
+    if(ringUsed(&tx)==SERIAL_TX_SIZE)
+    {
+        serialTxDropped++;
+        return 0;
+    }
+    txBuffer[tx.head & (SERIAL_TX_SIZE-1)]= c;
+    tx.head++;
+    return 0;
+}
+
+// at the start of each frame's service. the time between two of them is the worst
+// case delay of the USB interrupt plus one millisecond
+void serialFrame(void)
+{
+#ifdef ENABLE_STATS
+    static uint32_t last;
+    uint32_t now= statsCycles();
+    if(last)
+        statsAdd(STATS_USB_GAP, now-last);
+    last= now;
+#endif
+}
@@ -0,0 +1,31 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+// ring buffers between the USB interrupt and the main loop for the virtual serial port.
+// once per USB frame the interrupt side moves what the host sent into the receive
+// ring and takes up to one packet from the send ring. the main loop reads commands
+// with serialGet() and prints to a stream on serialPutChar(), which is stdout.
+// neither side ever waits for the other.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define SERIAL_RX_SIZE      128     // powers of two, at most 128; rx holds a whole packet
+#define SERIAL_TX_SIZE      128
+
+extern volatile uint8_t serialConnected;    // the host has the port open
+extern volatile uint16_t serialTxDropped;   // bytes printed into a full send ring
+
+// main loop side
+int16_t serialGet(void);                    // next received byte, -1 if there is none
+int serialPutChar(char c, FILE *stream);
+uint8_t serialTxFree(void);                 // room in the send ring
+uint8_t serialIdle(void);                   // nothing left to process or send
+
+// interrupt side, once per USB frame
+void serialFrame(void);
+uint8_t serialRxFree(void);
+void serialRxPut(uint8_t c);
+int16_t serialTxGet(void);
+
+#endif //SERIAL_H
@@ -0,0 +1,46 @@
+// AVR side of the benchmarks in host/benchcases.h: runs each case BENCH_CALLS
+// times with interrupts off and marks every call by writing the case number to
+// GPIOR1 before and GPIOR2 after it. lpavr -B counts the cycles in between.
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include "main.h"
+#include "../host/benchcases.h"
+
+#define BENCH_CALLS     256
+#define BENCH_START     GPIOR1
+#define BENCH_STOP      GPIOR2
+
+void settingsLoad(void);
+
+// nobody is on the serial port
+static int nullPut(char c, FILE *stream)
+{
+    return 0;
+}
+
+int main(void)
+{
+    static FILE nullOut= FDEV_SETUP_STREAM(nullPut, NULL, _FDEV_SETUP_WRITE);
+    uint8_t id= 0;
+    stdout= &nullOut;
+    settingsLoad();
+    benchSetup();
+
+#define BENCH_CASE(name, body)                      \
+    for(uint16_t i= 0; i<BENCH_CALLS; ++i)          \
+    {                                               \
+        BENCH_START= id;                            \
+        body;                                       \
+        BENCH_STOP= id;                             \
+    }                                               \
+    id++;
+    BENCH_CASES
+#undef BENCH_CASE
+
+    // sleeping with interrupts off ends the simulation
+    cli();
+    sleep_enable();
+    sleep_cpu();
+    return 0;
+}
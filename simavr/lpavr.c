@@ -0,0 +1,543 @@
+// runs the real firmware image under simavr, cycle accurate: the TM1001A model
+// from host/adbdev.c on PB3, button stimuli from an lpsim script, a VCD trace
+// of the ADB line, buttons, PWM registers and interrupts, and at the end the
+// cycles each interrupt took and the ADB bit timing the host produced.
+// for an ELF image it also watches the stack pointer after every instruction,
+// nested interrupts included, and fails if the deepest stack came closer than
+// STACK_MARGIN bytes to the end of .data and .bss. with -B it runs bench.c
+// instead and counts the cycles of each call.
+//
+//  lpavr -v trace.vcd ../main.elf ../host/golden/drag_hue.lps
+//  lpavr -B ../host/bench.budget bench.elf
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_hex.h"
+#include "sim_irq.h"
+#include "sim_interrupts.h"
+#include "sim_vcd_file.h"
+#include "avr_ioport.h"
+#include "avr_timer.h"
+#include "adbdev.h"
+#define BENCH_NAMES_ONLY
+#include "benchcases.h"
+
+#define MCU             "atmega32u4"
+#define FREQUENCY       16000000
+#define CYCLES_PER_US   (FREQUENCY/1000000)
+#define MAX_VECTORS     43
+#define MAX_PADS        4
+#define STACK_MARGIN    64      // bytes, for nesting deeper than the scripts got
+
+// board wiring, as in host/sim.c
+#define ADB_PORT        'B'
+#define ADB_BIT         3
+static const struct { char port; uint8_t bit; } buttonPins[4]=
+{
+    { 'B', 4 }, { 'E', 6 }, { 'D', 4 }, { 'D', 0 },
+};
+
+// ATmega32u4 vector numbers
+static const char *vectorNames[MAX_VECTORS]=
+{
+    [1]= "INT0", [7]= "INT6", [9]= "PCINT0", [10]= "USB_GEN", [11]= "USB_COM",
+    [12]= "WDT", [20]= "TIMER1_OVF", [21]= "TIMER0_COMPA", [22]= "TIMER0_COMPB",
+    [23]= "TIMER0_OVF", [30]= "EE_READY", [35]= "TIMER3_OVF",
+};
+
+// host ADB pulses are checked against the nominal times with this tolerance
+#define ADB_BIT_CELL        100     // us
+#define ADB_BIT_SHORT       35
+#define ADB_BIT_LONG        65
+#define ADB_ATT_MIN         400     // longer low pulses are attention or reset
+#define ADB_CELL_GAP        150     // a longer high time ends a run of bits
+
+// bench.c marks each call with the case number, data space addresses
+#define GPIOR1_ADDR         0x4A
+#define GPIOR2_ADDR         0x4B
+
+static avr_t *avr;
+static struct adbDevice pads[MAX_PADS];
+static int padCount= 1;
+static avr_irq_t *lineIrq, *adbPinIrq;
+static uint8_t ddrB, portB, lineLow, devLow[MAX_PADS];
+static FILE *dutyOut;
+static uint16_t duty[3];
+static int adbTolerance= 5;         // us
+static uint16_t staticEnd;          // first byte after .data and .bss, 0 for a hex file
+static uint16_t stackLow= 0xFFFF;   // lowest stack pointer seen
+
+struct isrStats
+{
+    uint32_t calls;
+    avr_cycle_count_t start, total, min, max;
+};
+static struct isrStats isr[MAX_VECTORS];
+
+struct pulseStats
+{
+    const char *name;
+    int nominal;                    // 0: not checked
+    uint32_t count, bad;
+    double min, max;
+};
+enum { PULSE_ONE, PULSE_ZERO, PULSE_CELL, PULSE_ATT, NPULSES };
+static struct pulseStats pulses[NPULSES]=
+{
+    { "1 bit low", ADB_BIT_SHORT },
+    { "0 bit low", ADB_BIT_LONG },
+    { "bit cell", ADB_BIT_CELL },
+    { "attention", 0 },
+};
+static avr_cycle_count_t hostFall, hostRise, lastBitFall;
+
+static uint32_t micros(void)
+{
+    return avr->cycle/CYCLES_PER_US;
+}
+
+static void pulse(int type, avr_cycle_count_t cycles)
+{
+    struct pulseStats *p= &pulses[type];
+    double us= (double)cycles/CYCLES_PER_US;
+    if(!p->count || us<p->min)
+        p->min= us;
+    if(!p->count || us>p->max)
+        p->max= us;
+    p->count++;
+    if(p->nominal && (us<p->nominal-adbTolerance || us>p->nominal+adbTolerance))
+        p->bad++;
+}
+
+// host pulse timing, at the exact cycle the firmware writes DDRB/PORTB
+static void hostEdge(uint8_t low)
+{
+    if(low)
+    {
+        if(lastBitFall && avr->cycle-hostRise<ADB_CELL_GAP*CYCLES_PER_US)
+            pulse(PULSE_CELL, avr->cycle-lastBitFall);
+        hostFall= avr->cycle;
+        return;
+    }
+    avr_cycle_count_t lowTime= avr->cycle-hostFall;
+    hostRise= avr->cycle;
+    if(lowTime>=ADB_ATT_MIN*CYCLES_PER_US)
+    {
+        pulse(PULSE_ATT, lowTime);
+        lastBitFall= 0;
+    }
+    else
+    {
+        pulse(lowTime<50*CYCLES_PER_US? PULSE_ONE: PULSE_ZERO, lowTime);
+        lastBitFall= hostFall;
+    }
+}
+
+// wired AND of the host and the pads, like adbLineStep() in host/sim.c
+static void lineStep(void)
+{
+    static uint8_t hostWasLow;
+    uint8_t hostLow= (ddrB & (1<<ADB_BIT)) && !(portB & (1<<ADB_BIT));
+    uint8_t low= hostLow;
+    if(hostLow!=hostWasLow)
+        hostEdge(hostLow),
+        hostWasLow= hostLow;
+    for(int i= 0; i<padCount; ++i)
+    {
+        uint8_t others= hostLow;
+        for(int j= 0; j<padCount; ++j)
+            others|= j!=i && devLow[j];
+        devLow[i]= adbDevUpdate(&pads[i], micros(), others);
+        low|= devLow[i];
+    }
+    if(low!=lineLow)
+    {
+        lineLow= low;
+        avr_raise_irq(adbPinIrq, !low);
+        avr_raise_irq(lineIrq, !low);
+    }
+}
+
+static void portBWrite(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    if(param)
+        ddrB= value;
+    else
+        portB= value;
+    lineStep();
+}
+
+// the pads run on microseconds, between the firmware's edges they need the time
+static avr_cycle_count_t lineTimer(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+    lineStep();
+    return when + CYCLES_PER_US;
+}
+
+static void isrRunning(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    struct isrStats *s= param;
+    if(value)
+    {
+        s->start= avr->cycle;
+        return;
+    }
+    avr_cycle_count_t c= avr->cycle-s->start;
+    if(!s->calls || c<s->min)
+        s->min= c;
+    if(c>s->max)
+        s->max= c;
+    s->total+= c;
+    s->calls++;
+}
+
+static void pwmWrite(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    int channel= (intptr_t)param;
+    if(duty[channel]==value)
+        return;
+    duty[channel]= value;
+    if(dutyOut)
+        fprintf(dutyOut, "%lu %u %u %u\n", (unsigned long)micros(), duty[0], duty[1], duty[2]);
+}
+
+#define BENCH_CASE(name, body)  #name,
+static const char *benchNames[]= { BENCH_CASES };
+#undef BENCH_CASE
+#define NBENCH  (sizeof(benchNames)/sizeof(benchNames[0]))
+static struct isrStats bench[NBENCH];
+
+static void benchMark(struct avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+    avr->data[addr]= v;
+    if(v<NBENCH)
+        isrRunning(NULL, addr==GPIOR1_ADDR, &bench[v]);
+}
+
+// runs bench.c to its end, prints cycles per call and checks them against the budgets.
+// a case without an AVR budget only warns, 'make bench-record' takes its average over
+static int runBench(const char *budgetFile)
+{
+    int over= 0, missing= 0, state;
+    avr_register_io_write(avr, GPIOR1_ADDR, benchMark, NULL);
+    avr_register_io_write(avr, GPIOR2_ADDR, benchMark, NULL);
+    while((state= avr_run(avr))!=cpu_Done && state!=cpu_Crashed)
+        ;
+    if(state==cpu_Crashed)
+    {
+        fprintf(stderr, "cpu crashed at pc 0x%04x\n", (unsigned)avr->pc);
+        return 1;
+    }
+    printf("%-20s %8s %8s %8s %8s\n", "function", "calls", "min", "avg", "max");
+    for(int i= 0; i<NBENCH; ++i)
+    {
+        struct isrStats *s= &bench[i];
+        long budget= benchBudget(budgetFile, benchNames[i], 1);
+        avr_cycle_count_t avg= s->calls? s->total/s->calls: 0;
+        printf("%-20s %8u %8llu %8llu %8llu", benchNames[i], s->calls, (unsigned long long)s->min,
+               (unsigned long long)avg, (unsigned long long)s->max);
+        if(budget>=0)
+            printf("  budget %6ld%s", budget, avg>budget? "  OVER": "");
+        else
+            printf("  no budget");
+        printf("\n");
+        if(budget<0)
+            missing++;
+        if(!s->calls || (budget>=0 && avg>budget))
+            over++;
+    }
+    if(missing)
+        fprintf(stderr, "warning: %d benchmarks without an AVR budget\n", missing);
+    if(over)
+        fprintf(stderr, "%d benchmarks over budget or not run\n", over);
+    return over? 1: 0;
+}
+
+static void runFor(uint32_t us)
+{
+    avr_cycle_count_t end= avr->cycle + (avr_cycle_count_t)us*CYCLES_PER_US;
+    while(avr->cycle<end)
+    {
+        int state= avr_run(avr);
+        if(state==cpu_Done || state==cpu_Crashed)
+        {
+            fprintf(stderr, "cpu %s at pc 0x%04x, cycle %llu\n", state==cpu_Done? "stopped": "crashed",
+                    (unsigned)avr->pc, (unsigned long long)avr->cycle);
+            exit(1);
+        }
+        uint16_t sp= avr->data[R_SPL] | avr->data[R_SPH]<<8;
+        if(sp<stackLow)
+            stackLow= sp;
+    }
+}
+
+// buttons are active low
+static void setButtons(uint8_t mask)
+{
+    for(int i= 0; i<4; ++i)
+        avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(buttonPins[i].port), buttonPins[i].bit),
+                      !(mask & (1<<i)));
+}
+
+// the lpsim script commands that don't need USB, see host/hostmain.c
+static int runScript(FILE *f, const char *name)
+{
+    struct adbDevice *pad= &pads[0];
+    static uint8_t last;
+    char line[256];
+    int lineNo= 0;
+    while(fgets(line, sizeof(line), f))
+    {
+        char cmd[32];
+        unsigned a, b, c, d, e;
+        lineNo++;
+        if(line[0]=='#' || sscanf(line, "%31s", cmd)!=1)
+            continue;
+        if(!strcmp(cmd, "wait") && sscanf(line, "%*s %u", &a)==1)
+            runFor(a*1000);
+        else if(!strcmp(cmd, "buttons") && sscanf(line, "%*s %i", (int *)&a)==1)
+        {
+            if(sscanf(line, "%*s %*i %u", &b)!=1)
+                b= 0;
+            for(int i= 0; i<4 && b; ++i)
+            {
+                setButtons(i&1? last: a);
+                runFor(b/4);
+            }
+            setButtons(a);
+            last= a;
+        }
+        else if(!strcmp(cmd, "pad") && sscanf(line, "%*s %u", &a)==1 && a<padCount)
+            pad= &pads[a];
+        else if(!strcmp(cmd, "touch") && sscanf(line, "%*s %u %u", &a, &b)==2)
+        {
+            if(sscanf(line, "%*s %*u %*u %u", &c)!=1)
+                c= 100;
+            adbDevTouch(pad, a, b, c);
+        }
+        else if(!strcmp(cmd, "drag") && sscanf(line, "%*s %u %u %u %u %u", &a, &b, &c, &d, &e)==5)
+        {
+            for(unsigned i= 0; i<=e; ++i)
+            {
+                int x= (int)a + ((int)c-(int)a)*(int)i/(int)(e? e: 1),
+                    y= (int)b + ((int)d-(int)b)*(int)i/(int)(e? e: 1);
+                adbDevTouch(pad, x, y, 100);
+                runFor(1000);
+            }
+        }
+        else if(!strcmp(cmd, "release"))
+            adbDevTouch(pad, 0, 0, 0);
+        else if(!strcmp(cmd, "cdc") || !strcmp(cmd, "frame") || !strcmp(cmd, "replay") || !strcmp(cmd, "print"))
+            fprintf(stderr, "%s:%d: '%s' needs the USB host, skipped\n", name, lineNo, cmd);
+        else
+        {
+            fprintf(stderr, "%s:%d: bad command: %s", name, lineNo, line);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int loadFirmware(const char *name)
+{
+    size_t len= strlen(name);
+    if(len>4 && !strcmp(name+len-4, ".hex"))
+    {
+        // a hex file doesn't say what it runs on
+        ihex_chunk_p chunks;
+        int n= read_ihex_chunks(name, &chunks);
+        if(n<=0)
+            return -1;
+        avr= avr_make_mcu_by_name(MCU);
+        avr_init(avr);
+        avr->frequency= FREQUENCY;
+        for(int i= 0; i<n; ++i)
+            if(chunks[i].baseaddr<avr->flashend)
+                avr_loadcode(avr, chunks[i].data, chunks[i].size, chunks[i].baseaddr);
+        return 0;
+    }
+    static elf_firmware_t fw;
+    if(elf_read_firmware(name, &fw))
+        return -1;
+    if(!fw.mmcu[0])
+        strcpy(fw.mmcu, MCU);
+    if(!fw.frequency)
+        fw.frequency= FREQUENCY;
+    avr= avr_make_mcu_by_name(fw.mmcu);
+    if(!avr)
+        return -1;
+    avr_init(avr);
+    avr_load_firmware(avr, &fw);
+    staticEnd= avr->ioend+1 + fw.datasize + fw.bsssize;
+    return 0;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-v vcdfile] [-o dutyfile] [-p pads] [-s ms] [-T us] firmware.elf|.hex [script...]\n"
+                    "       %s -B budgets bench.elf\n"
+                    "  -v FILE  VCD trace of the ADB line, buttons, PWM registers and interrupts\n"
+                    "  -o FILE  write 'time_us OCR1A OCR1B OCR3A' whenever one changes ('-' for stdout)\n"
+                    "  -p N     N touchpads on the ADB line (default 1)\n"
+                    "  -s MS    run this long for setup() before the scripts (default 400)\n"
+                    "  -T US    tolerance for the host's ADB pulses (default 5)\n"
+                    "  -B FILE  run the benchmarks in bench.c and check them against the budgets in FILE\n"
+                    "exits with 2 if the host's ADB pulses are off, 3 if the stack came near .bss (ELF only)\n",
+            argv0, argv0);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *vcdName= NULL, *budgetFile= NULL;
+    uint32_t setupMs= 400;
+    int opt;
+    while((opt= getopt(argc, argv, "v:o:p:s:T:B:h"))!=-1)
+    {
+        switch(opt)
+        {
+            case 'v': vcdName= optarg; break;
+            case 'o':
+                dutyOut= strcmp(optarg, "-")? fopen(optarg, "w"): stdout;
+                if(!dutyOut)
+                    perror(optarg), exit(1);
+                break;
+            case 'p':
+                padCount= atoi(optarg);
+                if(padCount<1 || padCount>MAX_PADS)
+                    usage(argv[0]);
+                break;
+            case 's': setupMs= atoi(optarg); break;
+            case 'T': adbTolerance= atoi(optarg); break;
+            case 'B': budgetFile= optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if(optind>=argc)
+        usage(argv[0]);
+    if(loadFirmware(argv[optind]))
+    {
+        fprintf(stderr, "%s: can't load\n", argv[optind]);
+        return 1;
+    }
+    if(budgetFile)
+        return runBench(budgetFile);
+
+    // pads all at address 3 after power-on, with different random numbers
+    for(int i= 0; i<padCount; ++i)
+        adbDevInit(&pads[i], 3),
+        pads[i].random+= i*53;
+    static const char *lineName[]= { "adb" };
+    lineIrq= avr_alloc_irq(&avr->irq_pool, 0, 1, lineName);
+    adbPinIrq= avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(ADB_PORT), ADB_BIT);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(ADB_PORT), IOPORT_IRQ_DIRECTION_ALL),
+                            portBWrite, (void *)1);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(ADB_PORT), IOPORT_IRQ_REG_PORT),
+                            portBWrite, NULL);
+    avr_raise_irq(adbPinIrq, 1);
+    avr_raise_irq(lineIrq, 1);
+    avr_cycle_timer_register(avr, CYCLES_PER_US, lineTimer, NULL);
+    setButtons(0);
+
+    avr_irq_t *pwm[3]=
+    {
+        avr_io_getirq(avr, AVR_IOCTL_TIMER_GETIRQ('1'), TIMER_IRQ_OUT_PWM0),
+        avr_io_getirq(avr, AVR_IOCTL_TIMER_GETIRQ('1'), TIMER_IRQ_OUT_PWM1),
+        avr_io_getirq(avr, AVR_IOCTL_TIMER_GETIRQ('3'), TIMER_IRQ_OUT_PWM0),
+    };
+    for(int i= 0; i<3; ++i)
+        if(pwm[i])
+            avr_irq_register_notify(pwm[i], pwmWrite, (void *)(intptr_t)i);
+
+    avr_irq_t *vectorIrq[MAX_VECTORS]= { 0 };
+    for(int v= 1; v<MAX_VECTORS; ++v)
+        if((vectorIrq[v]= avr_get_interrupt_irq(avr, v)))
+            avr_irq_register_notify(vectorIrq[v]+AVR_INT_IRQ_RUNNING, isrRunning, &isr[v]);
+
+    static avr_vcd_t vcd;
+    if(vcdName)
+    {
+        static const char *pwmNames[3]= { "OCR1A", "OCR1B", "OCR3A" };
+        avr_vcd_init(avr, vcdName, &vcd, 1000);
+        avr_vcd_add_signal(&vcd, lineIrq, 1, "adb");
+        for(int i= 0; i<4; ++i)
+        {
+            char name[16];
+            snprintf(name, sizeof(name), "button%d", i);
+            avr_vcd_add_signal(&vcd, avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(buttonPins[i].port),
+                               buttonPins[i].bit), 1, strdup(name));
+        }
+        for(int i= 0; i<3; ++i)
+            if(pwm[i])
+                avr_vcd_add_signal(&vcd, pwm[i], 16, pwmNames[i]);
+        for(int v= 1; v<MAX_VECTORS; ++v)
+            if(vectorIrq[v] && vectorNames[v])
+                avr_vcd_add_signal(&vcd, vectorIrq[v]+AVR_INT_IRQ_RUNNING, 1, vectorNames[v]);
+        avr_vcd_start(&vcd);
+    }
+
+    runFor(setupMs*1000);
+    for(int i= optind+1; i<argc; ++i)
+    {
+        FILE *f= strcmp(argv[i], "-")? fopen(argv[i], "r"): stdin;
+        if(!f)
+            perror(argv[i]), exit(1);
+        if(runScript(f, argv[i]))
+            return 1;
+        if(f!=stdin)
+            fclose(f);
+    }
+    if(vcdName)
+        avr_vcd_stop(&vcd);
+
+    // inclusive: an interrupt that lets others in counts their cycles too
+    double seconds= (double)avr->cycle/FREQUENCY;
+    printf("%-14s %8s %8s %8s %8s %7s\n", "interrupt", "calls", "min", "avg", "max", "cpu%");
+    for(int v= 1; v<MAX_VECTORS; ++v)
+    {
+        struct isrStats *s= &isr[v];
+        char num[8];
+        if(!s->calls)
+            continue;
+        snprintf(num, sizeof(num), "%d", v);
+        printf("%-14s %8u %8llu %8llu %8llu %6.2f%%\n", vectorNames[v]? vectorNames[v]: num, s->calls,
+               (unsigned long long)s->min, (unsigned long long)(s->total/s->calls),
+               (unsigned long long)s->max, 100.0*s->total/avr->cycle);
+    }
+    printf("%.3f s, %llu cycles\n\n", seconds, (unsigned long long)avr->cycle);
+
+    int bad= 0;
+    printf("%-14s %8s %8s %8s %8s\n", "adb host", "count", "min us", "max us", "off");
+    for(int i= 0; i<NPULSES; ++i)
+    {
+        struct pulseStats *p= &pulses[i];
+        printf("%-14s %8u %8.2f %8.2f %8u\n", p->name, p->count, p->min, p->max, p->bad);
+        bad+= p->bad;
+    }
+    for(int i= 0; i<padCount; ++i)
+        printf("pad %d: address %u, %u commands, %u responses, %u service requests, %u collisions\n", i,
+               pads[i].address, pads[i].commands, pads[i].responses, pads[i].srqs, pads[i].collisions);
+    if(bad)
+        printf("%d host pulses more than %d us off\n", bad, adbTolerance);
+
+    // the stack pointer points below the last byte pushed
+    int stackFull= 0;
+    if(staticEnd)
+    {
+        int left= stackLow+1-staticEnd;
+        printf("\nram: .data+.bss %u bytes, stack %u bytes deep, %d bytes left of %u\n",
+               staticEnd-(avr->ioend+1), avr->ramend-stackLow, left, avr->ramend-avr->ioend);
+        if(left<STACK_MARGIN)
+        {
+            printf("less than %d bytes between the stack and .bss\n", STACK_MARGIN);
+            stackFull= 1;
+        }
+    }
+    else
+        printf("\nram: not checked, a hex file has no section sizes\n");
+    return bad? 2: stackFull? 3: 0;
+}
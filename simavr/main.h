@@ -0,0 +1,23 @@
+// stand-in for lufa/main.h when the firmware sources are built without LUFA
+// for the benchmarks in bench.c
+#ifndef SIMAVR_MAIN_H
+#define SIMAVR_MAIN_H
+
+#include <avr/io.h>
+#include <avr/wdt.h>
+#include <avr/power.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "lightpainting.h"
+
+#define Delay_MS(ms)                _delay_ms(ms)
+#define GlobalInterruptEnable()     sei()
+
+void ProcessCDCChar(uint8_t c);
+bool ProcessCDCListing(void);
+
+#endif //SIMAVR_MAIN_H
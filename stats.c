@@ -0,0 +1,95 @@
+#include "stats.h"
+
+#ifdef ENABLE_STATS
+
+#include <stdio.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+// cycles at the last Timer1 overflow; TCNT1 counts the rest.
+// wraps after about 4.5 minutes, reset before reading the shares
+volatile uint32_t statsClock;
+
+static struct statsEntry stats[NSTATS];
+static uint32_t statsSince;
+
+static const char statsNames[NSTATS][8] PROGMEM=
+{
+    "timer1", "adb", "usbsof", "usbgap", "sched", "pwmlock",
+};
+
+uint32_t statsCycles(void)
+{
+    uint8_t sreg= SREG;
+    cli();
+    uint16_t t= TCNT1;
+    uint32_t c= statsClock;
+    // overflowed but the ISR hasn't counted it yet
+    if((TIFR1 & (1<<TOV1)) && t<(ICR1>>1))
+        c+= (uint32_t)ICR1+1;
+    SREG= sreg;
+    return c+t;
+}
+
+void statsAdd(uint8_t slot, uint32_t cycles)
+{
+    uint8_t bucket= 0;
+    for(uint32_t c= cycles>>4; c && bucket<STATS_BUCKETS-1; c>>= 1)
+        bucket++;
+    uint8_t sreg= SREG;
+    cli();
+    struct statsEntry *e= &stats[slot];
+    if(!e->count || cycles<e->min)
+        e->min= cycles;
+    if(cycles>e->max)
+        e->max= cycles;
+    e->count++;
+    e->total+= cycles;
+    if(e->hist[bucket]!=0xFFFF)
+        e->hist[bucket]++;
+    SREG= sreg;
+}
+
+void statsReset(void)
+{
+    uint8_t sreg= SREG;
+    cli();
+    memset(stats, 0, sizeof(stats));
+    statsSince= statsCycles();
+    SREG= sreg;
+}
+
+// one line per slot: name, count, min/avg/max cycles, share of the time since
+// the last reset in 0.1%, histogram counts from 16 cycles up
+// the elapsed time of the first row is the one the shares are computed from
+bool statsPrint(uint8_t row)
+{
+    static uint32_t elapsed;
+    struct statsEntry e;
+    if(!row)
+    {
+        elapsed= statsCycles()-statsSince;
+        printf_P(PSTR("%lu cycles\n"), (unsigned long)elapsed);
+        return true;
+    }
+    uint8_t i= row-1;
+    if(i>=NSTATS)
+        return false;
+    uint8_t sreg= SREG;
+    cli();
+    e= stats[i];
+    SREG= sreg;
+    char name[sizeof(statsNames[0])];
+    strcpy_P(name, statsNames[i]);
+    printf_P(PSTR("%-8s %6lu %6lu %6lu %6lu %4lu"), name, (unsigned long)e.count, (unsigned long)e.min,
+             (unsigned long)(e.count? e.total/e.count: 0), (unsigned long)e.max,
+             (unsigned long)(elapsed>>10? e.total/(elapsed>>10)*1000>>10: 0));
+    for(uint8_t k= 0; k<STATS_BUCKETS; ++k)
+        printf_P(PSTR(" %u"), e.hist[k]);
+    putchar('\n');
+    return true;
+}
+
+#endif //ENABLE_STATS
@@ -0,0 +1,59 @@
+#ifndef STATS_H
+#define STATS_H
+
+// cycle counting for the main loop parts and the interrupt handlers.
+// build with ENABLE_STATS defined (make STATS=1) to get them; otherwise the
+// macros are empty and nothing is compiled in.
+//
+//  STATS_BEGIN(slot);  ...  STATS_END(slot);
+//
+// records the cycles in between: count, min, max, sum and a histogram with
+// power of two buckets, the first one for 0-15 cycles.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+enum statsSlot
+{
+    STATS_TIMER1,       // Timer1 overflow ISR, including what nests into it
+    STATS_ADB,          // ADB pin change and timer0 compare ISRs
+    STATS_USB_FRAME,    // CDC endpoint service in the USB start of frame interrupt
+    STATS_USB_GAP,      // time between two of those, 1 ms plus their latency
+    STATS_SCHED,        // schedRun(), all main loop tasks
+    STATS_PWM_LOCK,     // Timer1 period work held back in the touchpad task
+    NSTATS
+};
+
+#ifdef ENABLE_STATS
+
+#define STATS_BUCKETS   12
+
+struct statsEntry
+{
+    uint32_t count;
+    uint32_t total;
+    uint32_t min, max;
+    uint16_t hist[STATS_BUCKETS];
+};
+
+extern volatile uint32_t statsClock;
+
+uint32_t statsCycles(void);
+void statsAdd(uint8_t slot, uint32_t cycles);
+void statsReset(void);
+bool statsPrint(uint8_t row);     // a listing row, false past the last
+
+#define STATS_BEGIN(slot)   uint32_t statsStart_##slot= statsCycles()
+#define STATS_END(slot)     statsAdd(slot, statsCycles()-statsStart_##slot)
+// in the Timer1 overflow ISR before interrupts are enabled again
+#define STATS_OVERFLOW(top) (statsClock+= (uint32_t)(top)+1)
+
+#else
+
+#define STATS_BEGIN(slot)
+#define STATS_END(slot)
+#define STATS_OVERFLOW(top)
+
+#endif //ENABLE_STATS
+
+#endif //STATS_H
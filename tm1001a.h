@@ -5,8 +5,10 @@
 #include <avr/wdt.h>
 #include <avr/power.h>
 #include <avr/interrupt.h>
+#include "adbabs.h"
 
-#if(!defined(ADB_PIN) || !defined(ADB_PINREG) || !defined(ADB_PORT) || !defined(ADB_PDIR) || !defined(ADB_TCNT) || !defined(TIMER_DIV))
+#if(!defined(ADB_PIN) || !defined(ADB_PINREG) || !defined(ADB_PORT) || !defined(ADB_PDIR) || !defined(ADB_TCNT) || !defined(TIMER_DIV) || \
+    !defined(ADB_PCMSK) || !defined(ADB_PCINT))
 #error "need to #define necessary stuff before including this"
 #endif
 
@@ -20,6 +22,7 @@
 #define ADB_PULSE_LONG		microsToTicks(65)
 #define ADB_PULSE_ATT		microsToTicks(570)
 #define ADB_PULSE_TIMEOUT	microsToTicks(250)
+#define ADB_PULSE_SRQ		microsToTicks(300)	// service request, from the stop bit's falling edge
 
 CASSERT(ADB_PULSE_ATT<256, pulseval);
 
@@ -67,13 +70,6 @@ void adbWriteByte(uint8_t b)
 
 
 // ADB Befehle
-#define COM_TALK0 0b00111100    // Adresse 3, Talk, Register0
-#define COM_TALK1 0b00111101    // Adresse 3, Talk, Register1
-#define COM_LISTEN1 0b00111001  // Adresse 3, Listen, Register1
-#define COM_TALK2 0b00111110    // Adresse 3, Talk, Register2
-#define COM_TALK3 0b00111111    // Adresse 3, Talk, Register3
-#define COM_LISTEN3 0b00111011  // Adresse 3, Listen, Register3
-
 #define ADBCMD_TALK		0b1100
 #define ADBCMD_LISTEN	0b1000
 #define ADB_cmdByte(cmd, address, register) ( (cmd) | ((address)<<4) | (register) )
@@ -126,6 +122,11 @@ int8_t adbExecuteCommand(uint8_t cmdByte, uint8_t *data, uint8_t nBytesOut)
 	}
 	else
 	{
+        // a device asking for service holds the stop bit low
+        adbOnPinTimeout(!adbPin(), ADB_PULSE_SRQ, 
+            { nBytesRead= -1; goto ret; }
+        );
+
 		// wait for data
         adbOnPinTimeout(adbPin(), ADB_PULSE_TIMEOUT, 
             { nBytesRead= 0; goto ret; }
@@ -162,25 +163,240 @@ int8_t adbExecuteCommand(uint8_t cmdByte, uint8_t *data, uint8_t nBytesOut)
 }
 
 
-uint8_t adbPoll(uint8_t *output)
+// interrupt driven transceiver.
+// timer0 compare match A times the pulses we send and the receive timeouts,
+// the pin change interrupt on ADB_PIN timestamps the edges of the device's response.
+// the main loop starts a talk with adbTalkStart() and picks up the data with
+// adbPollResult() some 2-6 ms later instead of blocking for the whole transaction.
+// a device that isn't addressed but has data to report holds the line low after
+// the stop bit (service request); adbAsync.srq tells so after the transaction.
+
+#define ADB_BUSY    (-2)
+
+// optional hooks at the start and end of both interrupt handlers, e.g. for profiling
+#ifndef ADB_ISR_ENTER
+#define ADB_ISR_ENTER()
+#define ADB_ISR_EXIT()
+#endif
+
+// called from the pin change ISR with the mask of the port's other pins that
+// changed since the last one; most of its calls are ADB edges with none
+#ifndef ADB_PCINT_OTHER
+#define ADB_PCINT_OTHER(changed)
+#endif
+
+enum adbState
+{
+    ADB_IDLE,
+    ADB_TX_LOW,         // pulling the line low for the current bit
+    ADB_TX_HIGH,        // releasing the line for the rest of the bit cell
+    ADB_RX_WAIT,        // waiting for the device to start talking
+    ADB_RX_START,       // inside the start bit
+    ADB_RX_BITS,        // receiving data bits
+};
+
+volatile struct
+{
+    uint8_t state;
+    uint8_t txByte;             // command byte being sent
+    uint8_t txCount;            // bits sent: sync bit, 8 command bits, stop bit
+    uint8_t txValue;            // value of the bit on the line
+    uint8_t tFall;              // timestamp of the last falling edge
+    uint8_t rxMask;             // mask of the next bit within the current byte
+    int8_t nBytes;              // complete bytes received / result
+    uint8_t data[8];
+    uint8_t lineHigh;           // line level at the last pin change interrupt
+    uint8_t srq;                // service request seen after the last command
+} adbAsync;
+
+// fire the compare interrupt 'ticks' timer0 ticks after the last scheduled point
+static inline void adbScheduleNext(uint8_t ticks)
+{
+    OCR0A+= ticks;
+}
+
+// fire the compare interrupt 'ticks' timer0 ticks from now
+static inline void adbScheduleFromNow(uint8_t ticks)
 {
-	// one poll should block for about 
-	// ADB_PULSE_ATT + (ADB_PULSE_SHORT+ADB_PULSE_LONG)*10 + ADB_PULSE_TIMEOUT = 
-	// 570 + (35+65)*10 + 250 =
-	// 1820 microseconds,
-	// plus the time of receiving data when a finger is on the pad
-	return adbExecuteCommand( ADB_cmdByte(ADBCMD_TALK, 3, 0),
-							  output, 0 );
+    OCR0A= ADB_TCNT + ticks;
 }
 
+static void adbAsyncFinish(void)
+{
+    ADB_PCMSK&= ~(1<<ADB_PCINT);
+    TIMSK0&= ~(1<<OCIE0A);
+    adbAsync.state= ADB_IDLE;
+}
 
-struct adbAbsMode
+void adbAsyncSetup(void)
 {
-    int xpos, ypos, pressure;
-    unsigned int button: 1, gesture: 1;
-};
+    PCICR|= (1<<PCIE0);
+    adbAsync.state= ADB_IDLE;
+}
+
+// start a TALK to a device register. the attention signal and the sync bit are
+// sent as one low pulse, then the command byte and the stop bit follow from the
+// compare interrupt.
+void adbTalkStart(uint8_t address, uint8_t reg)
+{
+    if(adbAsync.state!=ADB_IDLE)
+        return;
+    adbAsync.txByte= ADB_cmdByte(ADBCMD_TALK, address, reg);
+    adbAsync.txCount= 0;
+    adbAsync.srq= 0;
+    adbAsync.txValue= 1;
+    adbAsync.nBytes= 0;
+    adbAsync.state= ADB_TX_LOW;
+
+    uint8_t sreg= SREG;
+    cli();
+    adbPinLo();
+    adbScheduleFromNow(ADB_PULSE_ATT+ADB_PULSE_SHORT);
+    TIFR0= (1<<OCF0A);
+    TIMSK0|= (1<<OCIE0A);
+    SREG= sreg;
+}
+
+// TALK register 0 of the touchpad at its power-on address
+void adbPollStart(void)
+{
+    adbTalkStart(3, 0);
+}
+
+// returns ADB_BUSY while the transaction is running, otherwise the result of the last
+// poll: number of bytes received, 0 if the device had nothing to report, -1 on error
+int8_t adbPollResult(uint8_t *output)
+{
+    if(adbAsync.state!=ADB_IDLE)
+        return ADB_BUSY;
+    int8_t n= adbAsync.nBytes;
+    for(int8_t i= 0; i<n; ++i)
+        output[i]= adbAsync.data[i];
+    adbAsync.nBytes= 0;
+    return n;
+}
+
+ISR(TIMER0_COMPA_vect)
+{
+    ADB_ISR_ENTER();
+    switch(adbAsync.state)
+    {
+        case ADB_TX_LOW:
+            adbPinHi();
+            adbScheduleNext(adbAsync.txValue? ADB_PULSE_LONG: ADB_PULSE_SHORT);
+            adbAsync.state= ADB_TX_HIGH;
+            break;
+
+        case ADB_TX_HIGH:
+            if(++adbAsync.txCount<10)
+            {
+                // command bits msb first, then the stop bit (a 0)
+                adbAsync.txValue= adbAsync.txCount<9? (adbAsync.txByte >> (8-adbAsync.txCount)) & 1: 0;
+                adbPinLo();
+                adbScheduleNext(adbAsync.txValue? ADB_PULSE_SHORT: ADB_PULSE_LONG);
+                adbAsync.state= ADB_TX_LOW;
+            }
+            else
+            {
+                // command is out, wait for the device to answer. a service request
+                // still holds the line low; its end restarts the timeout
+                adbAsync.state= ADB_RX_WAIT;
+                adbScheduleNext(ADB_PULSE_TIMEOUT);
+                PCIFR= (1<<PCIF0);
+                adbAsync.lineHigh= adbPin()? 1: 0;
+                adbAsync.srq= !adbAsync.lineHigh;
+                ADB_PCMSK|= (1<<ADB_PCINT);
+            }
+            break;
+
+        case ADB_RX_WAIT:       // nothing to report
+            adbAsync.nBytes= 0;
+            adbAsyncFinish();
+            break;
+
+        case ADB_RX_START:      // start bit too long
+            adbAsync.nBytes= -1;
+            adbAsyncFinish();
+            break;
+
+        case ADB_RX_BITS:       // no more edges: stop bit seen, keep the complete bytes
+            adbAsyncFinish();
+            break;
+    }
+    ADB_ISR_EXIT();
+}
+
+static void adbEdge(uint8_t now, uint8_t high)
+{
+    switch(adbAsync.state)
+    {
+        case ADB_RX_WAIT:
+            if(high)
+            {
+                // end of a service request, the addressed device talks after it
+                adbScheduleFromNow(ADB_PULSE_TIMEOUT);
+                return;
+            }
+            adbAsync.state= ADB_RX_START;
+            break;
+
+        case ADB_RX_START:
+            if(high)
+                adbAsync.state= ADB_RX_BITS,
+                adbAsync.rxMask= 0x80;
+            break;
+
+        case ADB_RX_BITS:
+            if(!high)
+            {
+                adbAsync.tFall= now;
+                if(adbAsync.rxMask==0x80)
+                    adbAsync.data[adbAsync.nBytes]= 0;
+            }
+            else
+            {
+                if( (uint8_t)(now-adbAsync.tFall) < (ADB_PULSE_SHORT+ADB_PULSE_LONG)/2 )
+                    adbAsync.data[adbAsync.nBytes]|= adbAsync.rxMask;
+                if(!(adbAsync.rxMask>>= 1))
+                {
+                    adbAsync.rxMask= 0x80;
+                    if(++adbAsync.nBytes==8)
+                    {
+                        adbAsyncFinish();
+                        return;
+                    }
+                }
+            }
+            break;
+
+        default:
+            return;
+    }
+    adbScheduleFromNow(ADB_PULSE_SHORT+ADB_PULSE_LONG);
+}
+
+ISR(PCINT0_vect)
+{
+    static uint8_t lastPins= 0xFF;     // inputs with pull-ups idle high
+    uint8_t now= ADB_TCNT;
+    ADB_ISR_ENTER();
+    uint8_t pins= ADB_PINREG;
+    uint8_t high= (pins & (1<<ADB_PIN))? 1: 0;
+    // the port's other pins share this interrupt
+    if(high!=adbAsync.lineHigh)
+    {
+        adbAsync.lineHigh= high;
+        adbEdge(now, high);
+    }
+    uint8_t changed= (pins^lastPins) & ~(1<<ADB_PIN);
+    lastPins= pins;
+    if(changed)
+        ADB_PCINT_OTHER(changed);
+    ADB_ISR_EXIT();
+}
+
 
-void adbGetAbsModeData(struct adbAbsMode *ret, uint8_t *adbData)
+void adbGetAbsModeData(struct adbAbsMode *ret, const uint8_t *adbData)
 {
     ret->xpos= ((adbData[1] & 0x7F) << 2) |
                ((adbData[2] & 7) << 9) |
@@ -0,0 +1,78 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "trace.h"
+#include "sched.h"
+#include "serial.h"
+
+uint8_t traceRecording;
+static uint16_t lastTime;
+
+void traceStart(void)
+{
+    lastTime= schedTime();
+    traceRecording= 1;
+}
+
+void traceStop(void)
+{
+    traceRecording= 0;
+}
+
+// a record goes out whole or not at all, printing drops what doesn't fit. the
+// time of a dropped one adds to the next
+static bool recordHeader(uint8_t type, uint8_t length)
+{
+    if(serialTxFree()<length)
+        return false;
+    uint16_t now= schedTime();
+    uint16_t ticks= now-lastTime;
+    lastTime= now;
+    putchar(TRACE_MARK | type);
+    putchar(ticks & 0xFF);
+    putchar(ticks >> 8);
+    return true;
+}
+
+void traceButtons(uint8_t buttons)
+{
+    if(!traceRecording)
+        return;
+    if(recordHeader(TRACE_BUTTONS, 4))
+        putchar(buttons);
+}
+
+void traceAdb(uint8_t device, const uint8_t *data, uint8_t length)
+{
+    if(!traceRecording)
+        return;
+    if(!recordHeader(TRACE_ADB, 4+length))
+        return;
+    putchar(device<<4 | length);
+    for(uint8_t i= 0; i<length; ++i)
+        putchar(data[i]);
+}
+
+void traceCdc(uint8_t c)
+{
+    if(!traceRecording)
+        return;
+    if(recordHeader(TRACE_CDC, 4))
+        putchar(c);
+}
+
+void traceReplay(const uint8_t *record)
+{
+    switch(record[0] & 0x0F)
+    {
+        case TRACE_BUTTONS:
+            buttonApply(record[3]);
+            break;
+        case TRACE_ADB:
+            touchpadReport(record[3]>>4, record+4, record[3] & 0x0F);
+            break;
+        case TRACE_CDC:
+            ProcessCDCChar(record[3]);
+            break;
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// input trace: while recording, every button change, ADB report and byte received
+// on the serial port goes out on stdout as a record, interleaved with whatever else
+// is printed. host/lptrace saves them to a file, lpsim replays it.
+//
+// record:  TRACE_MARK|type, ticks since the previous record (16 bit, little endian), then
+//  TRACE_BUTTONS   held buttons, bit n = button n
+//  TRACE_ADB       device index<<4 | length, then the report bytes
+//  TRACE_CDC       the byte
+// the gap wraps at 0x10000 ticks like schedTime(): a pause of more than 0xFFFF ticks
+// (67 s) between two records replays shorter by a multiple of that. printed text never
+// contains TRACE_MARK and up, a reader skips to the next mark between records.
+// a trace file is TRACE_FILE_MAGIC followed by the records.
+
+#include <stdint.h>
+
+#define TRACE_MARK          0xB0
+#define TRACE_FILE_MAGIC    "LPT1"
+#define TRACE_MAX_RECORD    (3+1+8)
+
+enum traceType
+{
+    TRACE_BUTTONS,
+    TRACE_ADB,
+    TRACE_CDC,
+    NTRACETYPES
+};
+
+extern uint8_t traceRecording;
+
+void traceStart(void);
+void traceStop(void);
+void traceButtons(uint8_t buttons);
+void traceAdb(uint8_t device, const uint8_t *data, uint8_t length);
+void traceCdc(uint8_t c);
+
+// length of the record starting with these bytes, 0 if they don't start one.
+// needs the first 4 bytes
+static inline uint8_t traceRecordLength(const uint8_t *record)
+{
+    if((record[0] & 0xF0)!=TRACE_MARK)
+        return 0;
+    switch(record[0] & 0x0F)
+    {
+        case TRACE_BUTTONS:
+        case TRACE_CDC:
+            return 4;
+        case TRACE_ADB:
+            if((record[3] & 0x0F)>8)
+                return 0;
+            return 4 + (record[3] & 0x0F);
+    }
+    return 0;
+}
+
+static inline uint16_t traceRecordTicks(const uint8_t *record)
+{
+    return record[1] | (record[2]<<8);
+}
+
+// hand a record to the application, at its time
+void traceReplay(const uint8_t *record);
+
+// the application's entry points for replay, where the live input comes in
+void buttonApply(uint8_t buttons);
+void touchpadReport(uint8_t device, const uint8_t *data, int8_t length);
+void ProcessCDCChar(uint8_t c);
+
+#endif //TRACE_H
@@ -0,0 +1,66 @@
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "vendor.h"
+
+// received packets, the indices run freely and wrap at 256 like the serial rings
+static struct
+{
+    uint8_t data[VENDOR_EPSIZE];
+    uint8_t length;
+} rxPackets[VENDOR_RX_PACKETS];
+static volatile uint8_t rxHead, rxTail;
+
+// the newest report, double buffered like the color stream: the main loop fills
+// the slot that isn't pending, the interrupt takes the pending one
+static struct vendorReport txReports[2];
+static volatile uint8_t txPending;          // slot+1, 0 if none
+
+volatile uint16_t vendorPackets, vendorStallFrames;
+
+// the interrupt asks once per frame, so a full ring counts the frames a packet
+// waits in the endpoint, not the packets held back
+uint8_t *vendorRxSlot(void)
+{
+    if((uint8_t)(rxHead-rxTail)==VENDOR_RX_PACKETS)
+    {
+        vendorStallFrames++;
+        return 0;
+    }
+    return rxPackets[rxHead & (VENDOR_RX_PACKETS-1)].data;
+}
+
+void vendorRxPut(uint8_t length)
+{
+    rxPackets[rxHead & (VENDOR_RX_PACKETS-1)].length= length;
+    rxHead++;
+    vendorPackets++;
+}
+
+int8_t vendorGet(uint8_t *packet)
+{
+    if(rxHead==rxTail)
+        return -1;
+    uint8_t slot= rxTail & (VENDOR_RX_PACKETS-1);
+    uint8_t length= rxPackets[slot].length;
+    memcpy(packet, rxPackets[slot].data, length);
+    rxTail++;
+    return length;
+}
+
+void vendorSend(const struct vendorReport *report)
+{
+    uint8_t slot= txPending==1? 1: 0;
+    txReports[slot]= *report;
+    txPending= slot+1;
+}
+
+const struct vendorReport *vendorTxGet(void)
+{
+    if(!txPending)
+        return 0;
+    const struct vendorReport *report= &txReports[txPending-1];
+    txPending= 0;
+    return report;
+}
@@ -0,0 +1,53 @@
+#ifndef VENDOR_H
+#define VENDOR_H
+
+// packet buffers between the USB interrupt and the main loop for the vendor
+// interface, a raw interface next to the CDC console for programs that need
+// throughput and latency: interrupt endpoints of 64 bytes in both directions,
+// double banked and polled every frame, so a packet each way per millisecond.
+// usable with libusb or usbfs, no driver needed on Linux (see host/lpusb.c).
+//
+// OUT packets carry the binary color frames of the CDC stream (see
+// ProcessStreamFrame()), back to back, up to VENDOR_FRAMES of them. they are
+// handled in order as on the CDC stream, a frame replaces one the PWM hasn't
+// shown yet and counts as an overrun; streaming at the USB frame rate means one
+// frame per packet. IN packets are status reports, struct vendorReport; a
+// report nobody fetched yet is replaced by the next one.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define VENDOR_EPSIZE       64
+#define VENDOR_RX_PACKETS   4       // power of two, received packets the main loop hasn't taken yet
+#define VENDOR_FRAMES       (VENDOR_EPSIZE/10)
+
+#define VENDOR_REPORT_STATUS    1
+
+// all little endian, as the AVR stores it
+struct vendorReport
+{
+    uint8_t type;                   // VENDOR_REPORT_STATUS
+    uint8_t sequence;               // counts the reports
+    uint16_t time;                  // schedNow, ~ms
+    int16_t rgb[3];                 // color before calibration and curves
+    uint16_t duty[3];               // OCR1A, OCR1B, OCR3A
+    uint16_t top;                   // ICR1, full scale of the duty values
+    uint16_t frames, crcErrors, lost, overruns;     // of the color stream, CDC and vendor
+    uint16_t packets, stallFrames;  // vendor OUT packets taken, 1 ms frames one waited for a full ring
+    uint8_t buttons;
+    uint8_t transitions;            // held presets
+} __attribute__((packed));
+
+extern volatile uint16_t vendorPackets, vendorStallFrames;
+
+// main loop side
+int8_t vendorGet(uint8_t *packet);                  // copies the next packet, returns its length, -1 if none
+void vendorSend(const struct vendorReport *report);
+
+// interrupt side, once per USB frame
+uint8_t *vendorRxSlot(void);                        // where the next packet goes, 0 if the ring is full:
+                                                    // then it stays in its bank and the host is NAKed
+void vendorRxPut(uint8_t length);                   // the slot holds a packet now
+const struct vendorReport *vendorTxGet(void);       // report to send, 0 if there is no new one
+
+#endif //VENDOR_H